@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <cmath>
@@ -66,6 +67,10 @@ inline void sinc2rgb(RGB_pixel &rgb, uint8_t i) {
     rgb.g = clip(((i >> 2) & 1) * (((i >> 3)&1) + 3) * 60);
 }
 
+inline uint32_t rgb2argb(const RGB_pixel &rgb) {
+    return 0xff000000u | rgb.r << 16 | rgb.g << 8 | rgb.b;
+}
+
 inline void sinc2yuv(YUV_pixel &yuv, uint8_t i) {
     RGB_pixel rgb;
     sinc2rgb(rgb, i);
@@ -74,7 +79,25 @@ inline void sinc2yuv(YUV_pixel &yuv, uint8_t i) {
 
 extern YUV_pixel yuv_colors[16];
 
+/* Bulk kernels over n pixels, vectorized for the widest instruction set the
+ * CPU has: yuv_blend() applies the same weights to all pixels,
+ * (c1*w1 + c2*w2 + c3*w3) >> 4 with w1+w2+w3 = 16 and y below 2048, and
+ * yuv2argb() is yuv2rgb() followed by rgb2argb(). */
+void yuv_blend(const YUV_pixel *c1, const YUV_pixel *c2, const YUV_pixel *c3,
+               unsigned w1, unsigned w2, unsigned w3, YUV_pixel *out, size_t n);
+void yuv2argb(const YUV_pixel *src, uint32_t *dst, size_t n);
+
+/* instruction set levels from "scalar" (the reference) up, NULL terminated */
+extern const char *const simd_levels[];
+/* selects the best level the CPU supports, also for the screen decoder
+ * (see zx_decode_simd()) */
+void simd_init();
+/* selects the named level, false if unknown or not supported by the CPU */
+bool simd_select(const char *level);
+const char *simd_level();
+
 inline void color_init() {
+    simd_init();
     for (unsigned i = 0; i < 16; ++i) {
         YUV_pixel yuv;
         sinc2yuv(yuv, i);
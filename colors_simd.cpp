@@ -0,0 +1,230 @@
+#include <string.h>
+
+#include "colors.h"
+#include "zxscreen.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define HAVE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+static_assert(sizeof(YUV_pixel) == 3 * sizeof(int16_t), "YUV_pixel is blended as an int16 array");
+
+typedef void (*blend_fn)(const YUV_pixel *, const YUV_pixel *, const YUV_pixel *,
+                         unsigned, unsigned, unsigned, YUV_pixel *, size_t);
+typedef void (*convert_fn)(const YUV_pixel *, uint32_t *, size_t);
+
+/* the reference kernels */
+static void blend_scalar(const YUV_pixel *c1, const YUV_pixel *c2, const YUV_pixel *c3,
+                         unsigned w1, unsigned w2, unsigned w3, YUV_pixel *out, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        out[i].y = (c1[i].y * w1 + c2[i].y * w2 + c3[i].y * w3) >> 4;
+        out[i].u = (c1[i].u * int(w1) + c2[i].u * int(w2) + c3[i].u * int(w3)) >> 4;
+        out[i].v = (c1[i].v * int(w1) + c2[i].v * int(w2) + c3[i].v * int(w3)) >> 4;
+    }
+}
+
+static void convert_scalar(const YUV_pixel *src, uint32_t *dst, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        RGB_pixel rgb;
+        yuv2rgb(rgb, src[i]);
+        dst[i] = rgb2argb(rgb);
+    }
+}
+
+#ifdef HAVE_X86_KERNELS
+/* The kernels are written once with vector extensions and instantiated per
+ * instruction set by inlining them into functions compiled for it. */
+#define KERNEL inline __attribute__((always_inline))
+
+typedef int16_t i16x8 __attribute__((vector_size(16)));
+typedef int16_t i16x16 __attribute__((vector_size(32)));
+typedef int16_t i16x32 __attribute__((vector_size(64)));
+typedef int32_t i32x4 __attribute__((vector_size(16)));
+typedef int32_t i32x8 __attribute__((vector_size(32)));
+typedef int32_t i32x16 __attribute__((vector_size(64)));
+
+/* y, u and v blend the same, so the pixels are treated as one int16 array
+ * and the leftover elements are done one by one */
+template <typename I16>
+static KERNEL void blend_vec(const YUV_pixel *c1, const YUV_pixel *c2, const YUV_pixel *c3,
+                             unsigned w1, unsigned w2, unsigned w3, YUV_pixel *out, size_t n)
+{
+    const int16_t *a = reinterpret_cast<const int16_t *>(c1), *b = reinterpret_cast<const int16_t *>(c2);
+    const int16_t *c = reinterpret_cast<const int16_t *>(c3);
+    int16_t *o = reinterpret_cast<int16_t *>(out);
+    const int16_t k1 = w1, k2 = w2, k3 = w3;
+    const size_t lanes = sizeof(I16) / sizeof(int16_t), elems = 3 * n;
+    size_t i = 0;
+    for (; i + lanes <= elems; i += lanes) {
+        I16 va, vb, vc;
+        memcpy(&va, a + i, sizeof(I16));
+        memcpy(&vb, b + i, sizeof(I16));
+        memcpy(&vc, c + i, sizeof(I16));
+        const I16 r = (va * k1 + vb * k2 + vc * k3) >> 4;
+        memcpy(o + i, &r, sizeof(I16));
+    }
+    for (; i < elems; ++i)
+        o[i] = int16_t((a[i] * k1 + b[i] * k2 + c[i] * k3) >> 4);
+}
+
+/* yuv2rgb() on 32-bit lanes: d0 is the dword at a pixel (y, u), d1 the one
+ * 4 bytes further (v and the next pixel's y, shifted out) */
+template <typename I32>
+static KERNEL void convert_lanes(const I32 &d0, const I32 &d1, uint32_t *dst)
+{
+    const I32 y = d0 & 0xffff, u = d0 >> 16, v = (d1 << 16) >> 16;
+    const I32 r = y + v + (v >> 2) + (v >> 3) + (v >> 5);
+    const I32 g = y - (u >> 2) - (u >> 4) - (u >> 5) - (v >> 1) - (v >> 3) - (v >> 4) - (v >> 5);
+    const I32 b = y + u + (u >> 1) + (u >> 2);
+    const I32 argb = int32_t(0xff000000u) | (r & 0xff) << 16 | (g & 0xff) << 8 | (b & 0xff);
+    memcpy(dst, &argb, sizeof(I32));
+}
+
+/* the dwords at pixel i and 4 bytes further, d1 of the last pixel would be
+ * read past the end, so it is left to the scalar tail */
+static KERNEL void gather_sse2(const YUV_pixel *src, i32x4 &d0, i32x4 &d1)
+{
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(src);
+    int32_t a[4], b[4];
+    for (unsigned k = 0; k < 4; ++k) {
+        memcpy(&a[k], p + k * sizeof(YUV_pixel), 4);
+        memcpy(&b[k], p + k * sizeof(YUV_pixel) + 4, 4);
+    }
+    memcpy(&d0, a, sizeof(d0));
+    memcpy(&d1, b, sizeof(d1));
+}
+
+__attribute__((target("sse2")))
+static void blend_sse2(const YUV_pixel *c1, const YUV_pixel *c2, const YUV_pixel *c3,
+                       unsigned w1, unsigned w2, unsigned w3, YUV_pixel *out, size_t n)
+{
+    blend_vec<i16x8>(c1, c2, c3, w1, w2, w3, out, n);
+}
+
+__attribute__((target("sse2")))
+static void convert_sse2(const YUV_pixel *src, uint32_t *dst, size_t n)
+{
+    size_t i = 0;
+    for (; i + 4 < n; i += 4) {
+        i32x4 d0, d1;
+        gather_sse2(src + i, d0, d1);
+        convert_lanes(d0, d1, dst + i);
+    }
+    convert_scalar(src + i, dst + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void blend_avx2(const YUV_pixel *c1, const YUV_pixel *c2, const YUV_pixel *c3,
+                       unsigned w1, unsigned w2, unsigned w3, YUV_pixel *out, size_t n)
+{
+    blend_vec<i16x16>(c1, c2, c3, w1, w2, w3, out, n);
+}
+
+__attribute__((target("avx2")))
+static void convert_avx2(const YUV_pixel *src, uint32_t *dst, size_t n)
+{
+    const __m256i offsets = _mm256_setr_epi32(0, 6, 12, 18, 24, 30, 36, 42);
+    size_t i = 0;
+    for (; i + 8 < n; i += 8) {
+        const int *p = reinterpret_cast<const int *>(src + i);
+        const __m256i d0 = _mm256_i32gather_epi32(p, offsets, 1);
+        const __m256i d1 = _mm256_i32gather_epi32(p + 1, offsets, 1);
+        convert_lanes(i32x8(d0), i32x8(d1), dst + i);
+    }
+    convert_scalar(src + i, dst + i, n - i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void blend_avx512(const YUV_pixel *c1, const YUV_pixel *c2, const YUV_pixel *c3,
+                         unsigned w1, unsigned w2, unsigned w3, YUV_pixel *out, size_t n)
+{
+    blend_vec<i16x32>(c1, c2, c3, w1, w2, w3, out, n);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void convert_avx512(const YUV_pixel *src, uint32_t *dst, size_t n)
+{
+    const __m512i offsets = _mm512_setr_epi32(0, 6, 12, 18, 24, 30, 36, 42, 48, 54, 60, 66, 72, 78, 84, 90);
+    size_t i = 0;
+    for (; i + 16 < n; i += 16) {
+        const int *p = reinterpret_cast<const int *>(src + i);
+        const __m512i d0 = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), 0xffff, offsets, p, 1);
+        const __m512i d1 = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), 0xffff, offsets, p + 1, 1);
+        convert_lanes(i32x16(d0), i32x16(d1), dst + i);
+    }
+    convert_scalar(src + i, dst + i, n - i);
+}
+
+static bool has_sse2() {return __builtin_cpu_supports("sse2");}
+static bool has_avx2() {return __builtin_cpu_supports("avx2");}
+static bool has_avx512() {return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");}
+#endif
+
+static bool always() {return true;}
+
+struct simd_kernels {
+    const char *name;
+    bool (*supported)();
+    blend_fn blend;
+    convert_fn convert;
+    bool simd_decode; // the screen decoder's pshufb lines, every level from avx2 has SSSE3
+};
+
+/* in simd_levels order */
+static const simd_kernels kernels[] = {
+    {"scalar", always, blend_scalar, convert_scalar, false},
+#ifdef HAVE_X86_KERNELS
+    {"sse2", has_sse2, blend_sse2, convert_sse2, false},
+    {"avx2", has_avx2, blend_avx2, convert_avx2, true},
+    {"avx512", has_avx512, blend_avx512, convert_avx512, true},
+#endif
+};
+
+const char *const simd_levels[] = {
+    "scalar",
+#ifdef HAVE_X86_KERNELS
+    "sse2", "avx2", "avx512",
+#endif
+    NULL
+};
+
+static const simd_kernels *active = &kernels[0];
+
+void simd_init()
+{
+    for (const simd_kernels &k : kernels)
+        if (k.supported())
+            active = &k;
+    zx_decode_simd(active->simd_decode);
+}
+
+bool simd_select(const char *level)
+{
+    for (const simd_kernels &k : kernels) {
+        if (strcmp(k.name, level) == 0 && k.supported()) {
+            active = &k;
+            zx_decode_simd(k.simd_decode);
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *simd_level()
+{
+    return active->name;
+}
+
+void yuv_blend(const YUV_pixel *c1, const YUV_pixel *c2, const YUV_pixel *c3,
+               unsigned w1, unsigned w2, unsigned w3, YUV_pixel *out, size_t n)
+{
+    active->blend(c1, c2, c3, w1, w2, w3, out, n);
+}
+
+void yuv2argb(const YUV_pixel *src, uint32_t *dst, size_t n)
+{
+    active->convert(src, dst, n);
+}
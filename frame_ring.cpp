@@ -0,0 +1,140 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <new>
+
+#include "frame_ring.h"
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+              "the indices are shared between processes and must not need locks");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(int), "wakeups is used as a futex word");
+
+/* newest is frame number << 8 | slot, frame numbers start at 1; wakeups
+ * counts publish() and wake() calls, the consumer sleeps on it as a futex */
+struct frame_ring::shared {
+    uint32_t magic;
+    uint32_t slots;
+    std::atomic<uint64_t> newest;
+    std::atomic<uint32_t> held; // slot the consumer reads, SLOTS if none
+    std::atomic<uint32_t> wakeups;
+    zx_frame frame[SLOTS];
+};
+
+static const uint32_t MAGIC = 0x5a585242; // "ZXRB", frames with a border per line
+
+frame_ring::frame_ring(shared *s, const char *n, bool o)
+    : dropped(0), shm(s), name(strdup(n)), owner(o), writing(0), taken(0), woken(s->wakeups.load())
+{
+}
+
+frame_ring::~frame_ring()
+{
+    munmap(shm, sizeof(shared));
+    if (owner)
+        shm_unlink(name);
+    free(name);
+}
+
+frame_ring *frame_ring::create(const char *name)
+{
+    const int fd = shm_open(name, O_CREAT | O_RDWR, 0600);
+    if (fd == -1)
+        return NULL;
+    if (ftruncate(fd, sizeof(shared)) != 0) {
+        close(fd);
+        return NULL;
+    }
+    void *p = mmap(NULL, sizeof(shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return NULL;
+    shared *s = new (p) shared;
+    s->slots = SLOTS;
+    s->newest.store(0);
+    s->held.store(SLOTS);
+    s->wakeups.store(0);
+    memset(s->frame, 0, sizeof(s->frame));
+    std::atomic_thread_fence(std::memory_order_release);
+    s->magic = MAGIC;
+    return new frame_ring(s, name, true);
+}
+
+frame_ring *frame_ring::open(const char *name)
+{
+    const int fd = shm_open(name, O_RDWR, 0);
+    if (fd == -1)
+        return NULL;
+    void *p = mmap(NULL, sizeof(shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return NULL;
+    shared *s = static_cast<shared *>(p);
+    if (s->magic != MAGIC || s->slots != SLOTS) {
+        munmap(p, sizeof(shared));
+        errno = EPROTO;
+        return NULL;
+    }
+    return new frame_ring(s, name, false);
+}
+
+zx_frame *frame_ring::write_slot()
+{
+    // any slot but the newest and the held one, SLOTS >= 3 leaves at least one
+    const unsigned newest = shm->newest.load() & 0xff, held = shm->held.load();
+    writing = 0;
+    while (writing == newest || writing == held)
+        ++writing;
+    return &shm->frame[writing];
+}
+
+void frame_ring::publish()
+{
+    const uint64_t n = (shm->newest.load() >> 8) + 1;
+    shm->newest.store(n << 8 | writing);
+    wake();
+}
+
+const zx_frame *frame_ring::take()
+{
+    uint64_t newest = shm->newest.load();
+    if (newest >> 8 == taken)
+        return NULL;
+    // the producer may have picked the slot before seeing it held, in which
+    // case it has published a newer frame by now and that one is taken
+    for (;;) {
+        shm->held.store(newest & 0xff);
+        const uint64_t again = shm->newest.load();
+        if (again == newest)
+            break;
+        newest = again;
+    }
+    // the frames before the first one taken were published before the
+    // consumer attached, they were never its to drop
+    if (taken)
+        dropped += (newest >> 8) - taken - 1;
+    taken = newest >> 8;
+    return &shm->frame[newest & 0xff];
+}
+
+void frame_ring::wait()
+{
+    // a publish() or wake() since the last wait() changed the count, one
+    // after it is read makes the futex return at once, so none is missed
+    const uint32_t count = shm->wakeups.load();
+    if (count == woken && shm->newest.load() >> 8 == taken)
+        syscall(SYS_futex, reinterpret_cast<int *>(&shm->wakeups), FUTEX_WAIT, count, NULL, NULL, 0);
+    woken = shm->wakeups.load();
+}
+
+void frame_ring::wake()
+{
+    shm->wakeups.fetch_add(1);
+    syscall(SYS_futex, reinterpret_cast<int *>(&shm->wakeups), FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include "zxscreen.h"
+
+/* a screen frame as written by an emulator, the first 6912 bytes are laid
+ * out like a .scr file */
+struct zx_frame {
+    uint8_t pix[MAXY * 8][MAXX];
+    uint8_t attr[MAXY][MAXX];
+    uint8_t border[ZX_BORDER_H]; // colour 0-7 per line of the 320x240 frame
+};
+
+/* shared memory object used when none is given */
+const char *const FRAME_RING_NAME = "/zxscreen";
+
+/* Frames passed from one producer (an emulator) to one consumer (the viewer)
+ * through a POSIX shared memory object. The producer never writes to the
+ * newest frame nor to the one the consumer holds, so the consumer reads the
+ * frame in place and frames it did not get to are simply overwritten. */
+class frame_ring {
+public:
+    static const unsigned SLOTS = 4;
+
+    /* maps the named shared memory object, creating it for the producer;
+     * NULL on failure with errno set */
+    static frame_ring *create(const char *name);
+    static frame_ring *open(const char *name);
+    /* unmaps, the producer also removes the name */
+    ~frame_ring();
+
+    /* producer: a slot to fill, then publish() makes it the newest frame */
+    zx_frame *write_slot();
+    void publish();
+
+    /* consumer: the newest frame if it was published after the last one
+     * taken, else NULL. It stays untouched until the next take(). */
+    const zx_frame *take();
+    /* consumer: sleeps until a frame is published after the last one taken,
+     * wake() is called or a signal arrives; may return early, so callers
+     * check what they wait for again */
+    void wait();
+    /* ends a wait() from another thread or process, or a signal handler */
+    void wake();
+    /* consumer: the number of the frame taken last, frames are numbered
+     * from 1 in the order they are published */
+    uint64_t frame_number() const {return taken;}
+
+    /* frames published after the first one taken but never taken */
+    uint64_t dropped;
+
+private:
+    struct shared;
+
+    frame_ring(shared *s, const char *name, bool owner);
+
+    shared *shm;
+    char *name;
+    bool owner;
+    unsigned writing;  // producer's slot
+    uint64_t taken;    // consumer's last frame number
+    uint32_t woken;    // consumer's last wakeup count
+};
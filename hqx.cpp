@@ -29,25 +29,76 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "colors.h"
+#include "hqx.h"
+#include "perf.h"
+#include "thread_pool.h"
+
+/* weight sets used by the rules, (c1*w1 + c2*w2 + c3*w3) >> 4 */
+constexpr uint8_t hqx_weights[][3] = {
+    {16, 0, 0}, {14, 2, 0}, {12, 4, 0}, {10, 6, 0}, {8, 8, 0}, {12, 2, 2}, {10, 4, 2}, {8, 4, 4},
+    {14, 1, 1}, {2, 7, 7}, {4, 6, 6},
+};
+const unsigned HQX_OPS = sizeof(hqx_weights) / sizeof(hqx_weights[0]);
+
+constexpr unsigned weight_op(unsigned w1, unsigned w2, unsigned w3, unsigned op = 0)
+{
+    return op == HQX_OPS ||
+            (hqx_weights[op][0] == w1 && hqx_weights[op][1] == w2 && hqx_weights[op][2] == w3) ?
+                op : weight_op(w1, w2, w3, op + 1);
+}
+
+/* blend recipe: weight set op applied to w[c1], w[c2], w[c3], c1..c3 index the 3x3 window */
+struct hqx_blend {
+    uint8_t op;
+    uint8_t i[3];
+};
+
+/* weights in sixteenths */
+template <unsigned w1, unsigned w2, unsigned w3 = 0>
+hqx_blend mix16(uint8_t c1, uint8_t c2, uint8_t c3 = 4)
+{
+    static_assert(weight_op(w1, w2, w3) < HQX_OPS, "weights not in hqx_weights");
+    hqx_blend b = {weight_op(w1, w2, w3), {c1, c2, c3}};
+    return b;
+}
+
+/* weights in eighths, as most rules have them */
+template <unsigned w1, unsigned w2, unsigned w3 = 0>
+hqx_blend mix(uint8_t c1, uint8_t c2, uint8_t c3 = 4)
+{
+    return mix16<w1 * 2, w2 * 2, w3 * 2>(c1, c2, c3);
+}
+
+hqx_blend copy(uint8_t c) {return mix<8,0>(c, c);}
 
-/* (c1*w1 + c2*w2) >> s */
-template <unsigned w1, unsigned w2>
-void interp_2px(YUV_pixel &out, const YUV_pixel &c1, const YUV_pixel &c2)
+inline void blend(YUV_pixel &out, const hqx_blend &b, const YUV_pixel &c1, const YUV_pixel &c2, const YUV_pixel &c3)
 {
-    out.y = (c1.y * w1 + c2.y * w2) >> 3;
-    out.u = (c1.u * w1 + c2.u * w2) >> 3;
-    out.v = (c1.v * w1 + c2.v * w2) >> 3;
+    const uint8_t *w = hqx_weights[b.op];
+    out.y = (c1.y * w[0] + c2.y * w[1] + c3.y * w[2]) >> 4;
+    out.u = (c1.u * w[0] + c2.u * w[1] + c3.u * w[2]) >> 4;
+    out.v = (c1.v * w[0] + c2.v * w[1] + c3.v * w[2]) >> 4;
 }
 
-/* (c1*w1 + c2*w2 + c3*w3) >> s */
-template <unsigned w1, unsigned w2, unsigned w3>
-void interp_3px(YUV_pixel &out, const YUV_pixel &c1, const YUV_pixel &c2, const YUV_pixel &c3)
+/* Every output pixel is one of the weight sets applied to 3 of the 16
+ * palette colours, so all of them can be blended (and converted to ARGB)
+ * once: op << 12 | c1 << 8 | c2 << 4 | c3. */
+static YUV_pixel hqx_yuv[HQX_OPS << 12];
+static uint32_t hqx_argb[HQX_OPS << 12];
+
+inline unsigned blend_index(const hqx_blend &b, const uint8_t *w)
 {
-    out.y = (c1.y * w1 + c2.y * w2 + c3.y * w3) >> 3;
-    out.u = (c1.u * w1 + c2.u * w2 + c3.u * w3) >> 3;
-    out.v = (c1.v * w1 + c2.v * w2 + c3.v * w3)>> 3;
+    return b.op << 12 | w[b.i[0]] << 8 | w[b.i[1]] << 4 | w[b.i[2]];
 }
 
 /* m is the mask of diff with the center pixel that matters in the pattern, and
@@ -55,15 +106,20 @@ void interp_3px(YUV_pixel &out, const YUV_pixel &c1, const YUV_pixel &c2, const
  * center, 0 otherwise) */
 bool P(const uint8_t pattern, const uint8_t mask, const uint8_t result) {return (pattern & mask) == result;}
 
-/* Assuming p0..p8 is mapped to pixels 0..8, this function interpolates the
- * top-left block of 2x2 pixels in the total of the 4x4 pixels (or 4 blocks) to
- * interpolates. The function is also used for the 3 other blocks of 2x2
- * pixels. */
-void hq4x_interp_2x2_00(YUV_pixel &out, const uint8_t pattern, const uint8_t *w)
+/* edge diffs between the direct neighbours, the pattern only holds diffs
+ * with the center */
+enum { DIFF15 = 1, DIFF73 = 2, DIFF31 = 4 };
+
+/* Assuming p0..p8 is mapped to pixels 0..8, this function selects the blend
+ * for the top-left block of 2x2 pixels in the total of the 4x4 pixels (or 4
+ * blocks) to interpolate. The function is also used for the 3 other blocks of
+ * 2x2 pixels. The selection depends only on the pattern and the edge diffs,
+ * so it can be evaluated once for every combination by hqx_init(). */
+hqx_blend hq4x_rule_2x2_00(const uint8_t pattern, const uint8_t edges)
 {
-    const bool diff15 = diff(w[1], w[5]);
-    const bool diff73 = diff(w[7], w[3]);
-    const bool diff31 = diff(w[3], w[1]);
+    const bool diff15 = edges & DIFF15;
+    const bool diff73 = edges & DIFF73;
+    const bool diff31 = edges & DIFF31;
     const bool cond00 = (P(pattern, 0b10111111,0b00110111) || P(pattern, 0b11011011,0b00010011)) && diff15;
     const bool cond01 = (P(pattern, 0b11011011,0b01001001) || P(pattern, 0b11101111,0b01101101)) && diff73;
     const bool cond02 = (P(pattern, 0b01101111,0b00101010) || P(pattern, 0b1011011,0b1010) || P(pattern, 0b10111111,0b111010) || P(pattern, 0b11011111,0b1011010) ||
@@ -79,34 +135,34 @@ void hq4x_interp_2x2_00(YUV_pixel &out, const uint8_t pattern, const uint8_t *w)
                        P(pattern, 0x37,0x36) || P(pattern, 0xf9,0xf8) || P(pattern, 0xdd,0xdc) || P(pattern, 0xf3,0xf2) || P(pattern, 0xd7,0xd6) || P(pattern, 0xdd,0x1c) || P(pattern, 0xd7,0x16) || P(pattern, 0x0b,0x02);
 
     if (cond00)
-        interp_2px<5,3>(out, yuv_colors[w[4]], yuv_colors[w[3]]);
+        return mix<5,3>(4, 3);
     else if (cond01)
-        interp_2px<5,3>(out, yuv_colors[w[4]], yuv_colors[w[1]]);
+        return mix<5,3>(4, 1);
 
     else if ((P(pattern, 0x0b,0x0b) || P(pattern, 0xfe,0x4a) || P(pattern, 0xfe,0x1a)) && diff31)
-        out = yuv_colors[w[4]];
+        return copy(4);
     else if (cond02)
-        interp_2px<5,3>(out, yuv_colors[w[4]], yuv_colors[w[0]]);
+        return mix<5,3>(4, 0);
     else if (cond03)
-        interp_2px<6,2>(out, yuv_colors[w[4]], yuv_colors[w[3]]);
+        return mix<6,2>(4, 3);
     else if (cond04)
-        interp_2px<6,2>(out, yuv_colors[w[4]], yuv_colors[w[1]]);
+        return mix<6,2>(4, 1);
     else if (cond05)
-        interp_2px<5,3>(out, yuv_colors[w[4]], yuv_colors[w[3]]);
+        return mix<5,3>(4, 3);
     else if (cond06)
-        interp_2px<5,3>(out, yuv_colors[w[4]], yuv_colors[w[1]]);
+        return mix<5,3>(4, 1);
     else if (P(pattern, 0x0f,0x0b) || P(pattern, 0x5e,0x0a) || P(pattern, 0x2b,0x0b) || P(pattern, 0xbe,0x0a) || P(pattern, 0x7a,0x0a) || P(pattern, 0xee,0x0a))
-        interp_2px<4,4>(out, yuv_colors[w[1]], yuv_colors[w[3]]);
+        return mix<4,4>(1, 3);
     else if (cond07)
-        interp_2px<5,3>(out, yuv_colors[w[4]], yuv_colors[w[0]]);
+        return mix<5,3>(4, 0);
     else
-        interp_3px<4,2,2>(out, yuv_colors[w[4]], yuv_colors[w[1]], yuv_colors[w[3]]);
+        return mix<4,2,2>(4, 1, 3);
 }
 
-void hq4x_interp_2x2_01(YUV_pixel &out, const uint8_t pattern, const uint8_t *w)
+hqx_blend hq4x_rule_2x2_01(const uint8_t pattern, const uint8_t edges)
 {
-    const bool diff15 = diff(w[1], w[5]);
-    const bool diff31 = diff(w[3], w[1]);
+    const bool diff15 = edges & DIFF15;
+    const bool diff31 = edges & DIFF31;
     const bool cond00 = (P(pattern, 0b10111111,0b00110111) || P(pattern, 0b11011011,0b00010011)) && diff15;
     const bool cond02 = (P(pattern, 0b01101111,0b00101010) || P(pattern, 0b1011011,0b1010) || P(pattern, 0b10111111,0b111010) || P(pattern, 0b11011111,0b1011010) ||
                          P(pattern, 0b10011111,0b10001010) || P(pattern, 0b11001111,0b10001010) ||
@@ -125,39 +181,39 @@ void hq4x_interp_2x2_01(YUV_pixel &out, const uint8_t pattern, const uint8_t *w)
             P(pattern, 0x7e,0x0a) || P(pattern, 0xeb,0x4b) || P(pattern, 0x3b,0x1b);
 
     if (cond00)
-        interp_2px<7,1>(out, yuv_colors[w[4]], yuv_colors[w[3]]);
+        return mix<7,1>(4, 3);
     else if (cond08)
-        out = yuv_colors[w[4]];
+        return copy(4);
     else if (cond02)
-        interp_2px<6,2>(out, yuv_colors[w[4]], yuv_colors[w[0]]);
+        return mix<6,2>(4, 0);
     else if (cond09)
-        out = yuv_colors[w[4]];
+        return copy(4);
     else if (cond10)
-        interp_3px<5,2,1>(out, yuv_colors[w[4]], yuv_colors[w[1]], yuv_colors[w[3]]);
+        return mix<5,2,1>(4, 1, 3);
     else if (P(pattern, 0x0b,0x08))
-        interp_3px<5,2,1>(out, yuv_colors[w[4]], yuv_colors[w[1]], yuv_colors[w[0]]);
+        return mix<5,2,1>(4, 1, 0);
     else if (cond11)
-        interp_2px<5,3>(out, yuv_colors[w[4]], yuv_colors[w[1]]);
+        return mix<5,3>(4, 1);
     else if (cond04)
-        interp_2px<6,2>(out, yuv_colors[w[1]], yuv_colors[w[4]]);
+        return mix<6,2>(1, 4);
     else if (cond12)
-        interp_3px<4,2,2>(out, yuv_colors[w[1]], yuv_colors[w[4]], yuv_colors[w[3]]);
+        return mix<4,2,2>(1, 4, 3);
     else if (cond13)
-        interp_2px<5,3>(out, yuv_colors[w[1]], yuv_colors[w[3]]);
+        return mix<5,3>(1, 3);
     else if (cond05)
-        interp_2px<7,1>(out, yuv_colors[w[4]], yuv_colors[w[3]]);
+        return mix<7,1>(4, 3);
     else if (P(pattern, 0xf3,0x62) || P(pattern, 0x67,0x66) || P(pattern, 0x37,0x36) || P(pattern, 0xf3,0xf2) || P(pattern, 0xd7,0xd6) || P(pattern, 0xd7,0x16) || P(pattern, 0x0b,0x02))
-        interp_2px<6,2>(out, yuv_colors[w[4]], yuv_colors[w[0]]);
+        return mix<6,2>(4, 0);
     else if (cond14)
-        interp_2px<4,4>(out, yuv_colors[w[1]], yuv_colors[w[4]]);
+        return mix<4,4>(1, 4);
     else
-        interp_2px<6,2>(out, yuv_colors[w[4]], yuv_colors[w[1]]);
+        return mix<6,2>(4, 1);
 }
 
-void hq4x_interp_2x2_10(YUV_pixel &out, const uint8_t pattern, const uint8_t *w)
+hqx_blend hq4x_rule_2x2_10(const uint8_t pattern, const uint8_t edges)
 {
-    const bool diff73 = diff(w[7], w[3]);
-    const bool diff31 = diff(w[3], w[1]);
+    const bool diff73 = edges & DIFF73;
+    const bool diff31 = edges & DIFF31;
     const bool cond01 = (P(pattern, 0b11011011,0b01001001) || P(pattern, 0b11101111,0b01101101)) && diff73;
     const bool cond02 = (P(pattern, 0b01101111,0b00101010) || P(pattern, 0b1011011,0b1010) || P(pattern, 0b10111111,0b111010) || P(pattern, 0b11011111,0b1011010) ||
                          P(pattern, 0b10011111,0b10001010) || P(pattern, 0b11001111,0b10001010) ||
@@ -176,38 +232,38 @@ void hq4x_interp_2x2_10(YUV_pixel &out, const uint8_t pattern, const uint8_t *w)
     const bool cond15 = P(pattern, 0x0b,0x03);
 
     if (cond01)
-        interp_2px<7,1>(out, yuv_colors[w[4]], yuv_colors[w[1]]);
+        return mix<7,1>(4, 1);
     else if (cond08)
-        out = yuv_colors[w[4]];
+        return copy(4);
     else if (cond02)
-        interp_2px<6,2>(out, yuv_colors[w[4]], yuv_colors[w[0]]);
+        return mix<6,2>(4, 0);
     else if (cond09)
-        out = yuv_colors[w[4]];
+        return copy(4);
     else if (cond10)
-        interp_3px<5,2,1>(out, yuv_colors[w[4]], yuv_colors[w[3]], yuv_colors[w[1]]);
+        return mix<5,2,1>(4, 3, 1);
     else if (P(pattern, 0x0b,0x02))
-        interp_3px<5,2,1>(out, yuv_colors[w[4]], yuv_colors[w[3]], yuv_colors[w[0]]);
+        return mix<5,2,1>(4, 3, 0);
     else if (cond15)
-        interp_2px<5,3>(out, yuv_colors[w[4]], yuv_colors[w[3]]);
+        return mix<5,3>(4, 3);
     else if (cond03)
-        interp_2px<6,2>(out, yuv_colors[w[3]], yuv_colors[w[4]]);
+        return mix<6,2>(3, 4);
     else if (cond13)
-        interp_3px<4,2,2>(out, yuv_colors[w[3]], yuv_colors[w[4]], yuv_colors[w[1]]);
+        return mix<4,2,2>(3, 4, 1);
     else if (cond12)
-        interp_2px<5,3>(out, yuv_colors[w[3]], yuv_colors[w[1]]);
+        return mix<5,3>(3, 1);
     else if (cond06)
-        interp_2px<7,1>(out, yuv_colors[w[4]], yuv_colors[w[1]]);
+        return mix<7,1>(4, 1);
     else if (P(pattern, 0x0b,0x08) || P(pattern, 0xf9,0x68) || P(pattern, 0x6d,0x6c) || P(pattern, 0x3d,0x3c) || P(pattern, 0xf9,0xf8) || P(pattern, 0xdd,0xdc) || P(pattern, 0xdd,0x1c))
-        interp_2px<6,2>(out, yuv_colors[w[4]], yuv_colors[w[0]]);
+        return mix<6,2>(4, 0);
     else if (cond14)
-        interp_2px<4,4>(out, yuv_colors[w[3]], yuv_colors[w[4]]);
+        return mix<4,4>(3, 4);
     else
-        interp_2px<6,2>(out, yuv_colors[w[4]], yuv_colors[w[3]]);
+        return mix<6,2>(4, 3);
 }
 
-void hq4x_interp_2x2_11(YUV_pixel &out, const uint8_t pattern, const uint8_t *w)
+hqx_blend hq4x_rule_2x2_11(const uint8_t pattern, const uint8_t edges)
 {
-    bool diff31 = diff(w[3], w[1]);
+    const bool diff31 = edges & DIFF31;
     const bool cond02 = (P(pattern, 0b01101111,0b00101010) || P(pattern, 0b1011011,0b1010) || P(pattern, 0b10111111,0b111010) || P(pattern, 0b11011111,0b1011010) ||
                          P(pattern, 0b10011111,0b10001010) || P(pattern, 0b11001111,0b10001010) ||
                         P(pattern, 0b11101111,0b1001110) || P(pattern, 0b111111,0b1110) || P(pattern, 0b11111011,0b1011010) || P(pattern, 0b10111011,0b10001010) ||
@@ -221,23 +277,234 @@ void hq4x_interp_2x2_11(YUV_pixel &out, const uint8_t pattern, const uint8_t *w)
 
 
     if ((P(pattern, 0x7f,0x2b) || P(pattern, 0xef,0xab) || P(pattern, 0xbf,0x8f) || P(pattern, 0x7f,0x0f)) && diff31)
-        out = yuv_colors[w[4]];
+        return copy(4);
     else if (cond02)
-        interp_2px<7,1>(out, yuv_colors[w[4]], yuv_colors[w[0]]);
+        return mix<7,1>(4, 0);
     else if (cond15)
-        interp_2px<7,1>(out, yuv_colors[w[4]], yuv_colors[w[3]]);
+        return mix<7,1>(4, 3);
     else if (cond11)
-        interp_2px<7,1>(out, yuv_colors[w[4]], yuv_colors[w[1]]);
+        return mix<7,1>(4, 1);
     else if (P(pattern, 0x0a,0x00) || P(pattern, 0x7e,0x2a) || P(pattern, 0xef,0xab) || P(pattern, 0xbf,0x8f) || P(pattern, 0x7e,0x0e))
-        interp_3px<6,1,1>(out, yuv_colors[w[4]], yuv_colors[w[3]], yuv_colors[w[1]]);
+        return mix<6,1,1>(4, 3, 1);
     else if (cond07)
-        interp_2px<7,1>(out, yuv_colors[w[4]], yuv_colors[w[0]]);
+        return mix<7,1>(4, 0);
     else
-        out = yuv_colors[w[4]];
+        return copy(4);
 }
 
-void hqx_filter(const uint8_t *src, YUV_pixel *dst, unsigned width, unsigned height)
+/* hq2x: the output block is one pixel per quadrant */
+hqx_blend hq2x_rule_1x1(const uint8_t pattern, const uint8_t edges)
+{
+    const bool diff15 = edges & DIFF15;
+    const bool diff73 = edges & DIFF73;
+    const bool diff31 = edges & DIFF31;
+
+    if ((P(pattern, 0xbf,0x37) || P(pattern, 0xdb,0x13)) && diff15)
+        return mix<6,2>(4, 3);
+    else if ((P(pattern, 0xdb,0x49) || P(pattern, 0xef,0x6d)) && diff73)
+        return mix<6,2>(4, 1);
+    else if ((P(pattern, 0x0b,0x0b) || P(pattern, 0xfe,0x4a) || P(pattern, 0xfe,0x1a)) && diff31)
+        return copy(4);
+    else if ((P(pattern, 0x6f,0x2a) || P(pattern, 0x5b,0x0a) || P(pattern, 0xbf,0x3a) || P(pattern, 0xdf,0x5a) ||
+              P(pattern, 0x9f,0x8a) || P(pattern, 0xcf,0x8a) || P(pattern, 0xef,0x4e) || P(pattern, 0x3f,0x0e) ||
+              P(pattern, 0xfb,0x5a) || P(pattern, 0xbb,0x8a) || P(pattern, 0x7f,0x5a) || P(pattern, 0xaf,0x8a) ||
+              P(pattern, 0xeb,0x8a)) && diff31)
+        return mix<4,2,2>(4, 3, 1);
+    else if (P(pattern, 0x0b,0x08))
+        return mix<4,2,2>(4, 0, 1);
+    else if (P(pattern, 0x0b,0x02))
+        return mix<4,2,2>(4, 0, 3);
+    else if (P(pattern, 0x2f,0x2f))
+        return mix16<14,1,1>(4, 3, 1);
+    else if (P(pattern, 0xbf,0x37) || P(pattern, 0xdb,0x13))
+        return mix<5,2,1>(4, 1, 3);
+    else if (P(pattern, 0xdb,0x49) || P(pattern, 0xef,0x6d))
+        return mix<5,2,1>(4, 3, 1);
+    else if (P(pattern, 0x1b,0x03) || P(pattern, 0x4f,0x43) || P(pattern, 0x8b,0x83) || P(pattern, 0x6b,0x43))
+        return mix<6,2>(4, 3);
+    else if (P(pattern, 0x4b,0x09) || P(pattern, 0x8b,0x89) || P(pattern, 0x1f,0x19) || P(pattern, 0x3b,0x19))
+        return mix<6,2>(4, 1);
+    else if (P(pattern, 0x7e,0x2a) || P(pattern, 0xef,0xab) || P(pattern, 0xbf,0x8f) || P(pattern, 0x7e,0x0e))
+        return mix<2,3,3>(4, 3, 1);
+    else if (P(pattern, 0xfb,0x6a) || P(pattern, 0x6f,0x6e) || P(pattern, 0x3f,0x3e) || P(pattern, 0xfb,0xfa) ||
+             P(pattern, 0xdf,0xde) || P(pattern, 0xdf,0x1e))
+        return mix<6,2>(4, 0);
+    else if (P(pattern, 0x0a,0x00) || P(pattern, 0x4f,0x4b) || P(pattern, 0x9f,0x1b) || P(pattern, 0x2f,0x0b) ||
+             P(pattern, 0xbe,0x0a) || P(pattern, 0xee,0x0a) || P(pattern, 0x7e,0x0a) || P(pattern, 0xeb,0x4b) ||
+             P(pattern, 0x3b,0x1b))
+        return mix<4,2,2>(4, 3, 1);
+    else
+        return mix<6,1,1>(4, 3, 1);
+}
+
+/* hq3x: the corner pixel of the quadrant. The quadrants also get an edge
+ * pixel each, the center of the 3x3 block is the source pixel. */
+hqx_blend hq3x_rule_2x1_00(const uint8_t pattern, const uint8_t edges)
+{
+    const bool diff15 = edges & DIFF15;
+    const bool diff73 = edges & DIFF73;
+    const bool diff31 = edges & DIFF31;
+
+    if ((P(pattern, 0xdb,0x49) || P(pattern, 0xef,0x6d)) && diff73)
+        return mix<6,2>(4, 1);
+    else if ((P(pattern, 0xbf,0x37) || P(pattern, 0xdb,0x13)) && diff15)
+        return mix<6,2>(4, 3);
+    else if ((P(pattern, 0x0b,0x0b) || P(pattern, 0xfe,0x4a) || P(pattern, 0xfe,0x1a)) && diff31)
+        return copy(4);
+    else if ((P(pattern, 0x6f,0x2a) || P(pattern, 0x5b,0x0a) || P(pattern, 0xbf,0x3a) || P(pattern, 0xdf,0x5a) ||
+              P(pattern, 0x9f,0x8a) || P(pattern, 0xcf,0x8a) || P(pattern, 0xef,0x4e) || P(pattern, 0x3f,0x0e) ||
+              P(pattern, 0xfb,0x5a) || P(pattern, 0xbb,0x8a) || P(pattern, 0x7f,0x5a) || P(pattern, 0xaf,0x8a) ||
+              P(pattern, 0xeb,0x8a)) && diff31)
+        return mix16<2,7,7>(4, 3, 1);
+    else if (P(pattern, 0x0f,0x0b) || P(pattern, 0x5e,0x0a) || P(pattern, 0x2b,0x0b) || P(pattern, 0xbe,0x0a) ||
+             P(pattern, 0x7a,0x0a) || P(pattern, 0xee,0x0a))
+        return mix<4,4>(1, 3);
+    else if (P(pattern, 0x0b,0x08) || P(pattern, 0xf9,0x68) || P(pattern, 0xf3,0x62) || P(pattern, 0x6d,0x6c) ||
+             P(pattern, 0x67,0x66) || P(pattern, 0x3d,0x3c) || P(pattern, 0x37,0x36) || P(pattern, 0xf9,0xf8) ||
+             P(pattern, 0xdd,0xdc) || P(pattern, 0xf3,0xf2) || P(pattern, 0xd7,0xd6) || P(pattern, 0xdd,0x1c) ||
+             P(pattern, 0xd7,0x16) || P(pattern, 0x0b,0x02))
+        return mix<6,2>(4, 0);
+    else
+        return mix<4,2,2>(4, 3, 1);
+}
+
+/* hq3x: the edge pixel right of the corner, between the corner of this
+ * quadrant (w3/w1 edge) and the one of the next quadrant (w1/w5 edge). It
+ * keeps the source pixel unless the top neighbour is similar or a line
+ * crosses one of the two corners. */
+hqx_blend hq3x_rule_2x1_01(const uint8_t pattern, const uint8_t edges)
+{
+    const bool diff15 = edges & DIFF15;
+    const bool diff31 = edges & DIFF31;
+    const bool cond00 = P(pattern, 0xbf,0x37) || P(pattern, 0xdb,0x13);
+    const bool cond01 = P(pattern, 0xbf,0x8f) || P(pattern, 0x7e,0x0e);
+    const bool cond02 = P(pattern, 0x9b,0x92) || P(pattern, 0xf7,0xb6);
+    const bool cond03 = P(pattern, 0x7e,0x2a) || P(pattern, 0xef,0xab);
+
+    if (P(pattern, 0x02,0x00))
+        return mix<6,2>(4, 1);
+    else if ((cond00 || cond02) && diff15)
+        return copy(4);
+    else if ((cond01 || cond03) && diff31)
+        return copy(4);
+    else if (cond00 || cond01)
+        return mix<6,2>(1, 4);
+    else if (cond02 || cond03)
+        return mix<6,2>(4, 1);
+    else if (P(pattern, 0x1a,0x12) && !diff15)
+        return mix<7,1>(4, 1);
+    else if (P(pattern, 0x0a,0x0a) && !diff31)
+        return mix<7,1>(4, 1);
+    else
+        return copy(4);
+}
+
+typedef hqx_blend (*rule_fn)(const uint8_t, const uint8_t);
+
+/* window index -> index in the transposed window (rows and columns swapped) */
+static const uint8_t hqx_transpose[9] = {0, 3, 6, 1, 4, 7, 2, 5, 8};
+
+/* pattern bit of window index i, the center has none */
+inline unsigned pattern_bit(unsigned i) {return i < 4 ? i : i - 1;}
+
+/* rule for the transposed window: the rule of a pixel right of the corner
+ * applied to the pixel below it */
+template <rule_fn rule>
+hqx_blend transposed(const uint8_t pattern, const uint8_t edges)
+{
+    uint8_t t = 0;
+    for (unsigned i = 0; i < 9; ++i)
+        if (i != 4 && (pattern >> pattern_bit(i) & 1))
+            t |= 1 << pattern_bit(hqx_transpose[i]);
+    const uint8_t e = (edges & DIFF15 ? DIFF73 : 0) | (edges & DIFF73 ? DIFF15 : 0) | (edges & DIFF31);
+    hqx_blend b = rule(t, e);
+    for (unsigned c = 0; c < 3; ++c)
+        b.i[c] = hqx_transpose[b.i[c]];
+    return b;
+}
+
+/* Output block of scale factor N: its 4 quadrants are the rules of the
+ * top-left one mirrored (window indices in the quadrant's mirrored window),
+ * PIXELS rules per quadrant with their (x, y) offsets in the N x N block
+ * and the names of the top-left quadrant's rules.
+ * The center pixel of hq3x is in no quadrant, it is the source pixel. */
+template <unsigned N> struct hqx_layout;
+
+template <> struct hqx_layout<2> {
+    static const unsigned PIXELS = 1;
+    static const rule_fn rules[4][PIXELS];
+    static const uint8_t pos[4][PIXELS][2];
+    static const char *const names[PIXELS];
+};
+
+const rule_fn hqx_layout<2>::rules[4][1] = {{hq2x_rule_1x1}, {hq2x_rule_1x1}, {hq2x_rule_1x1}, {hq2x_rule_1x1}};
+const uint8_t hqx_layout<2>::pos[4][1][2] = {{{0, 0}}, {{1, 0}}, {{0, 1}}, {{1, 1}}};
+const char *const hqx_layout<2>::names[1] = {"hq2x_rule_1x1"};
+
+/* every quadrant has the edge pixel after its corner going clockwise */
+template <> struct hqx_layout<3> {
+    static const unsigned PIXELS = 2;
+    static const rule_fn rules[4][PIXELS];
+    static const uint8_t pos[4][PIXELS][2];
+    static const char *const names[PIXELS];
+};
+
+const rule_fn hqx_layout<3>::rules[4][2] = {
+    {hq3x_rule_2x1_00, hq3x_rule_2x1_01},
+    {hq3x_rule_2x1_00, transposed<hq3x_rule_2x1_01>},
+    {hq3x_rule_2x1_00, transposed<hq3x_rule_2x1_01>},
+    {hq3x_rule_2x1_00, hq3x_rule_2x1_01},
+};
+const uint8_t hqx_layout<3>::pos[4][2][2] = {
+    {{0, 0}, {1, 0}},
+    {{2, 0}, {2, 1}},
+    {{0, 2}, {0, 1}},
+    {{2, 2}, {1, 2}},
+};
+const char *const hqx_layout<3>::names[2] = {"hq3x_rule_2x1_00", "hq3x_rule_2x1_01"};
+
+template <> struct hqx_layout<4> {
+    static const unsigned PIXELS = 4;
+    static const rule_fn rules[4][PIXELS];
+    static const uint8_t pos[4][PIXELS][2];
+    static const char *const names[PIXELS];
+};
+
+const rule_fn hqx_layout<4>::rules[4][4] = {
+    {hq4x_rule_2x2_00, hq4x_rule_2x2_01, hq4x_rule_2x2_10, hq4x_rule_2x2_11},
+    {hq4x_rule_2x2_00, hq4x_rule_2x2_01, hq4x_rule_2x2_10, hq4x_rule_2x2_11},
+    {hq4x_rule_2x2_00, hq4x_rule_2x2_01, hq4x_rule_2x2_10, hq4x_rule_2x2_11},
+    {hq4x_rule_2x2_00, hq4x_rule_2x2_01, hq4x_rule_2x2_10, hq4x_rule_2x2_11},
+};
+/* the 2x2 blends of each quadrant */
+const uint8_t hqx_layout<4>::pos[4][4][2] = {
+    {{0, 0}, {1, 0}, {0, 1}, {1, 1}},
+    {{3, 0}, {2, 0}, {3, 1}, {2, 1}},
+    {{0, 3}, {1, 3}, {0, 2}, {1, 2}},
+    {{3, 3}, {2, 3}, {3, 2}, {2, 2}},
+};
+const char *const hqx_layout<4>::names[4] = {"hq4x_rule_2x2_00", "hq4x_rule_2x2_01", "hq4x_rule_2x2_10",
+                                             "hq4x_rule_2x2_11"};
+
+/* mirrored window index -> 3x3 window index of the 4 quadrants */
+static const uint8_t hqx_mirror[4][8] = {
+    {0, 1, 2, 3, 4, 5, 6, 7},
+    {2, 1, 0, 5, 4, 3, 0, 7},
+    {6, 7, 0, 3, 4, 5, 0, 1},
+    {8, 7, 0, 5, 4, 3, 0, 1},
+};
+
+/* reference path, evaluates the rules for every pixel */
+static uint8_t edge_diffs(const uint8_t *w)
+{
+    return diff(w[1], w[5]) * DIFF15 | diff(w[7], w[3]) * DIFF73 | diff(w[3], w[1]) * DIFF31;
+}
+
+template <unsigned N>
+void filter_ref(const uint8_t *src, YUV_pixel *dst, unsigned width, unsigned height)
 {
+    typedef hqx_layout<N> layout;
+    const unsigned dst_linesize = N * width;
     for (int y = 0; y < height; ++y) {
         const int prevline = y > 0          ? -width : 0;
         const int nextline = y < height - 1 ?  width : 0;
@@ -257,37 +524,463 @@ void hqx_filter(const uint8_t *src, YUV_pixel *dst, unsigned width, unsigned hei
             const bool diff6 = diff(w[4], w[6]);
             const bool diff7 = diff(w[4], w[7]);
             const bool diff8 = diff(w[4], w[8]);
-            uint8_t pattern = diff0 | diff1 << 1| diff2 << 2| diff3 << 3| diff5 << 4| diff6 << 5| diff7 << 6| diff8 << 7;
-            unsigned dst_linesize = 4 * width;
-            hq4x_interp_2x2_00(dst[0], pattern, w); // 00 01 10 11
-            hq4x_interp_2x2_01(dst[1], pattern, w); // 00 01 10 11
-            hq4x_interp_2x2_10(dst[dst_linesize], pattern, w); // 00 01 10 11
-            hq4x_interp_2x2_11(dst[dst_linesize + 1], pattern, w); // 00 01 10 11
-            //2,1,0,5,3,8,7,6
-            pattern = diff2 | diff1 << 1 | diff0 << 2 | diff5 << 3 | diff3 << 4 | diff8 << 5 | diff7 << 6 | diff6 << 7;
-
-            const uint8_t W1[] = {w[2], w[1], 0, w[5], w[4], w[3], 0, w[7]};
-            hq4x_interp_2x2_00(dst[3], pattern, W1); // 02 03 12 13 (vert mirrored)
-            hq4x_interp_2x2_01(dst[2], pattern, W1); // 02 03 12 13 (vert mirrored)
-            hq4x_interp_2x2_10(dst[dst_linesize + 3], pattern, W1); // 02 03 12 13 (vert mirrored)
-            hq4x_interp_2x2_11(dst[dst_linesize + 2], pattern, W1); // 02 03 12 13 (vert mirrored)
-            //6,7,8,3,5,0,1,2
-            pattern = diff6 | diff7 << 1 | diff8 << 2 | diff3 << 3| diff5 << 4|diff0 << 5| diff1 << 6| diff2 << 7;
-            const uint8_t W2[] = {w[6], w[7], 0, w[3], w[4], w[5], 0, w[1]};
-            hq4x_interp_2x2_00(dst[3 * dst_linesize], pattern, W2); // 20 21 30 31 (horiz mirrored)
-            hq4x_interp_2x2_01(dst[3 * dst_linesize + 1], pattern, W2); // 20 21 30 31 (horiz mirrored)
-            hq4x_interp_2x2_10(dst[2 * dst_linesize], pattern, W2); // 20 21 30 31 (horiz mirrored)
-            hq4x_interp_2x2_11(dst[2 * dst_linesize + 1], pattern, W2); // 20 21 30 31 (horiz mirrored)
-            //8,7,6,5,3,2,1,0
-            pattern = diff8 | diff7 << 1| diff6 << 2| diff5 << 3| diff3 << 4| diff2 << 5| diff1 << 6| diff0 << 7;
-            const uint8_t W3[] = {w[8], w[7], 0, w[5], w[4], w[3], 0, w[1]};
-            hq4x_interp_2x2_00(dst[3 * dst_linesize + 3], pattern, W3); // 22 23 32 33 (center mirrored)
-            hq4x_interp_2x2_01(dst[3 * dst_linesize + 2], pattern, W3); // 22 23 32 33 (center mirrored)
-            hq4x_interp_2x2_10(dst[2 * dst_linesize + 3], pattern, W3); // 22 23 32 33 (center mirrored)
-            hq4x_interp_2x2_11(dst[2 * dst_linesize + 2], pattern, W3); // 22 23 32 33 (center mirrored)
+            const uint8_t pattern[4] = {
+                uint8_t(diff0 | diff1 << 1 | diff2 << 2 | diff3 << 3 | diff5 << 4 | diff6 << 5 | diff7 << 6 | diff8 << 7),
+                //2,1,0,5,3,8,7,6 (vert mirrored)
+                uint8_t(diff2 | diff1 << 1 | diff0 << 2 | diff5 << 3 | diff3 << 4 | diff8 << 5 | diff7 << 6 | diff6 << 7),
+                //6,7,8,3,5,0,1,2 (horiz mirrored)
+                uint8_t(diff6 | diff7 << 1 | diff8 << 2 | diff3 << 3 | diff5 << 4 | diff0 << 5 | diff1 << 6 | diff2 << 7),
+                //8,7,6,5,3,2,1,0 (center mirrored)
+                uint8_t(diff8 | diff7 << 1 | diff6 << 2 | diff5 << 3 | diff3 << 4 | diff2 << 5 | diff1 << 6 | diff0 << 7),
+            };
+            YUV_pixel *out = dst + y * N * dst_linesize + x * N;
+            for (unsigned q = 0; q < 4; ++q) {
+                uint8_t W[8];
+                for (unsigned i = 0; i < 8; ++i)
+                    W[i] = w[hqx_mirror[q][i]];
+                for (unsigned r = 0; r < layout::PIXELS; ++r) {
+                    const hqx_blend b = layout::rules[q][r](pattern[q], edge_diffs(W));
+                    blend(out[layout::pos[q][r][1] * dst_linesize + layout::pos[q][r][0]], b,
+                          yuv_colors[W[b.i[0]]], yuv_colors[W[b.i[1]]], yuv_colors[W[b.i[2]]]);
+                }
+            }
+            if (N == 3)
+                out[dst_linesize + 1] = yuv_colors[w[4]];
             ++src;
-            dst += 4;
         }
-        dst += width * 4 * 3;
     }
 }
+
+/* For every quadrant the table holds the blends of the layout indexed by
+ * the mirrored pattern and edge diffs, with the window indices already
+ * mapped back to the unmirrored 3x3 window. */
+template <unsigned N>
+struct hqx_table {
+    static hqx_blend blend[4][1 << 11][hqx_layout<N>::PIXELS];
+
+    static void init()
+    {
+        typedef hqx_layout<N> layout;
+        for (unsigned q = 0; q < 4; ++q) {
+            for (unsigned k = 0; k < (1 << 11); ++k) {
+                for (unsigned r = 0; r < layout::PIXELS; ++r) {
+                    hqx_blend b = layout::rules[q][r](k & 0xff, k >> 8);
+                    for (unsigned c = 0; c < 3; ++c)
+                        b.i[c] = hqx_mirror[q][b.i[c]];
+                    blend[q][k][r] = b;
+                }
+            }
+        }
+    }
+};
+
+template <unsigned N>
+hqx_blend hqx_table<N>::blend[4][1 << 11][hqx_layout<N>::PIXELS];
+
+void hqx_init()
+{
+    std::vector<YUV_pixel> c1(1 << 12), c2(1 << 12), c3(1 << 12);
+    for (unsigned k = 0; k < (1 << 12); ++k) {
+        c1[k] = yuv_colors[k >> 8 & 0xf];
+        c2[k] = yuv_colors[k >> 4 & 0xf];
+        c3[k] = yuv_colors[k & 0xf];
+    }
+    for (unsigned op = 0; op < HQX_OPS; ++op) {
+        const uint8_t *w = hqx_weights[op];
+        YUV_pixel *out = hqx_yuv + (op << 12);
+        yuv_blend(c1.data(), c2.data(), c3.data(), w[0], w[1], w[2], out, 1 << 12);
+        yuv2argb(out, hqx_argb + (op << 12), 1 << 12);
+    }
+    hqx_table<2>::init();
+    hqx_table<3>::init();
+    hqx_table<4>::init();
+}
+
+inline void emit(YUV_pixel &out, const hqx_blend &b, const uint8_t *w)
+{
+    out = hqx_yuv[blend_index(b, w)];
+}
+
+inline void emit(uint32_t &out, const hqx_blend &b, const uint8_t *w)
+{
+    out = hqx_argb[blend_index(b, w)];
+}
+
+/* The pattern stage works on diff words: bits 0-7 are the pattern of the
+ * top-left quadrant (diffs of the center to w0 w1 w2 w3 w5 w6 w7 w8), bits
+ * 8-11 the edge diffs 1-5, 3-7, 1-3 and 5-7. Mirroring a quadrant permutes
+ * these bits, so the other 3 keys are derived from it with delta swaps
+ * (bits m and m << s trade places) and bit 11 is dropped. */
+enum { DW_D15 = 1 << 8, DW_D37 = 1 << 9, DW_D13 = 1 << 10, DW_D57 = 1 << 11 };
+
+template <unsigned s, unsigned m>
+inline unsigned swap_bits(unsigned x)
+{
+    const unsigned t = (x >> s ^ x) & m;
+    return x ^ t ^ t << s;
+}
+
+#if defined(__SSE2__)
+template <unsigned s, unsigned m>
+inline __m128i swap_bits(__m128i x)
+{
+    const __m128i t = _mm_and_si128(_mm_xor_si128(_mm_srli_epi16(x, s), x), _mm_set1_epi16(m));
+    return _mm_xor_si128(x, _mm_xor_si128(t, _mm_slli_epi16(t, s)));
+}
+#endif
+
+/* diff word -> diff word of quadrant 1 (mirrored left-right): 2 1 0 5 3 8 7 6,
+ * edges 1-3 5-7 1-5 3-7 */
+template <typename V>
+inline V mirror_x(V x)
+{
+    return swap_bits<1, 0x008>(swap_bits<2, 0x321>(x));
+}
+
+/* quadrant 2 (mirrored top-bottom): 6 7 8 3 5 0 1 2, edges 5-7 1-3 3-7 1-5 */
+template <typename V>
+inline V mirror_y(V x)
+{
+    return swap_bits<1, 0x200>(swap_bits<3, 0x100>(swap_bits<5, 0x007>(x)));
+}
+
+/* quadrant 3 (both): 8 7 6 5 3 2 1 0, edges 3-7 1-5 5-7 1-3 */
+template <typename V>
+inline V mirror_xy(V x)
+{
+    return swap_bits<1, 0x508>(swap_bits<3, 0x004>(swap_bits<5, 0x002>(swap_bits<7, 0x001>(x))));
+}
+
+/* diff word of the 3x3 window w, the reference for the row stage below */
+inline unsigned diff_word(const uint8_t *w)
+{
+    return diff(w[4], w[0]) | diff(w[4], w[1]) << 1 | diff(w[4], w[2]) << 2 | diff(w[4], w[3]) << 3 |
+           diff(w[4], w[5]) << 4 | diff(w[4], w[6]) << 5 | diff(w[4], w[7]) << 6 | diff(w[4], w[8]) << 7 |
+           diff(w[1], w[5]) * DW_D15 | diff(w[3], w[7]) * DW_D37 | diff(w[1], w[3]) * DW_D13 |
+           diff(w[5], w[7]) * DW_D57;
+}
+
+/* spans are processed in chunks of this many pixels */
+const unsigned SPAN_CHUNK = 64;
+
+/* a chunk of 3 source lines padded with the pixels left and right of it
+ * (clamped at the frame edges): column i + 1 is chunk pixel i */
+struct span_rows {
+    uint8_t row[3][SPAN_CHUNK + 16];
+
+    span_rows(const uint8_t *prev, const uint8_t *cur, const uint8_t *next, unsigned width,
+              unsigned x, unsigned n)
+    {
+        const uint8_t *src[3] = {prev, cur, next};
+        const unsigned xp = x > 0 ? x - 1 : x, xn = x + n < width ? x + n : x + n - 1;
+        for (unsigned r = 0; r < 3; ++r) {
+            memset(row[r] + n + 2, 0, sizeof(row[r]) - n - 2);
+            row[r][0] = src[r][xp];
+            memcpy(row[r] + 1, src[r] + x, n);
+            row[r][n + 1] = src[r][xn];
+        }
+    }
+
+    void window(unsigned i, uint8_t *w) const
+    {
+        for (unsigned r = 0; r < 3; ++r)
+            for (unsigned c = 0; c < 3; ++c)
+                w[r * 3 + c] = row[r][i + c];
+    }
+};
+
+#if defined(__SSE2__)
+/* the 4 quadrant keys of all chunk pixels: the 12 diffs of 16 pixels are
+ * byte compares of the shifted lines, black 0 and 8 folded together first */
+inline void span_keys(const span_rows &rows, unsigned n, uint16_t (*keys)[SPAN_CHUNK])
+{
+    const __m128i eight = _mm_set1_epi8(8);
+    for (unsigned i = 0; i < n; i += 16) {
+        __m128i v[3][3];
+        for (unsigned r = 0; r < 3; ++r) {
+            for (unsigned c = 0; c < 3; ++c) {
+                const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows.row[r] + i + c));
+                v[r][c] = _mm_xor_si128(p, _mm_and_si128(_mm_cmpeq_epi8(p, eight), eight));
+            }
+        }
+#define NE(a, b, bit) _mm_andnot_si128(_mm_cmpeq_epi8(a, b), _mm_set1_epi8(char(bit)))
+        const __m128i &w0 = v[0][0], &w1 = v[0][1], &w2 = v[0][2], &w3 = v[1][0], &w4 = v[1][1];
+        const __m128i &w5 = v[1][2], &w6 = v[2][0], &w7 = v[2][1], &w8 = v[2][2];
+        const __m128i lo = _mm_or_si128(
+                _mm_or_si128(_mm_or_si128(NE(w4, w0, 0x01), NE(w4, w1, 0x02)), _mm_or_si128(NE(w4, w2, 0x04), NE(w4, w3, 0x08))),
+                _mm_or_si128(_mm_or_si128(NE(w4, w5, 0x10), NE(w4, w6, 0x20)), _mm_or_si128(NE(w4, w7, 0x40), NE(w4, w8, 0x80))));
+        const __m128i hi = _mm_or_si128(_mm_or_si128(NE(w1, w5, DW_D15 >> 8), NE(w3, w7, DW_D37 >> 8)),
+                                        _mm_or_si128(NE(w1, w3, DW_D13 >> 8), NE(w5, w7, DW_D57 >> 8)));
+#undef NE
+        const __m128i mask = _mm_set1_epi16(0x7ff);
+        for (unsigned h = 0; h < 2; ++h) {
+            const __m128i x = h ? _mm_unpackhi_epi8(lo, hi) : _mm_unpacklo_epi8(lo, hi);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(keys[0] + i + h * 8), _mm_and_si128(x, mask));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(keys[1] + i + h * 8), _mm_and_si128(mirror_x(x), mask));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(keys[2] + i + h * 8), _mm_and_si128(mirror_y(x), mask));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(keys[3] + i + h * 8), _mm_and_si128(mirror_xy(x), mask));
+        }
+    }
+}
+#else
+inline void span_keys(const span_rows &rows, unsigned n, uint16_t (*keys)[SPAN_CHUNK])
+{
+    for (unsigned i = 0; i < n; ++i) {
+        uint8_t w[9];
+        rows.window(i, w);
+        const unsigned x = diff_word(w);
+        keys[0][i] = x & 0x7ff;
+        keys[1][i] = mirror_x(x) & 0x7ff;
+        keys[2][i] = mirror_y(x) & 0x7ff;
+        keys[3][i] = mirror_xy(x) & 0x7ff;
+    }
+}
+#endif
+
+/* one source line: prev, cur and next are the lines above, at and below
+ * (the same line at the frame edges), out receives N output lines */
+template <unsigned N, typename Pixel>
+void filter_span(const uint8_t *prev, const uint8_t *cur, const uint8_t *next, unsigned width,
+                 unsigned x0, unsigned x1, Pixel *out, unsigned pitch)
+{
+    typedef hqx_layout<N> layout;
+    static const hqx_blend center = copy(4);
+    perf_thread_counters &counters = perf_local();
+    const bool count_rules = perf_count_rules.load(std::memory_order_relaxed);
+    unsigned solids = 0;
+    uint16_t keys[4][SPAN_CHUNK];
+    for (unsigned x = x0; x < x1; x += SPAN_CHUNK) {
+        const unsigned n = x1 - x < SPAN_CHUNK ? x1 - x : SPAN_CHUNK;
+        const span_rows rows(prev, cur, next, width, x, n);
+        span_keys(rows, n, keys);
+        // the key picks the branch of every rule of the quadrant
+        if (count_rules)
+            for (unsigned q = 0; q < 4; ++q)
+                for (unsigned i = 0; i < n; ++i)
+                    perf_add(counters.keys[q][keys[q][i]], 1);
+        for (unsigned i = 0; i < n; ++i) {
+            uint8_t w[9];
+            rows.window(i, w);
+            if ((keys[0][i] | keys[3][i]) == 0) {
+                // no diffs in the window (the 2 keys hold all 12): a solid block
+                ++solids;
+                Pixel solid;
+                emit(solid, center, w);
+                for (unsigned r = 0; r < N; ++r)
+                    for (unsigned c = 0; c < N; ++c)
+                        out[r * pitch + c] = solid;
+                out += N;
+                continue;
+            }
+            for (unsigned q = 0; q < 4; ++q) {
+                const hqx_blend *b = hqx_table<N>::blend[q][keys[q][i]];
+                for (unsigned r = 0; r < layout::PIXELS; ++r, ++b)
+                    emit(out[layout::pos[q][r][1] * pitch + layout::pos[q][r][0]], *b, w);
+            }
+            if (N == 3)
+                emit(out[pitch + 1], center, w);
+            out += N;
+        }
+    }
+    perf_add(counters.count[PERF_HQX_PIXELS], x1 - x0);
+    perf_add(counters.count[PERF_HQX_SOLID], solids);
+}
+
+template <unsigned N, typename Pixel>
+void filter_rect(const uint8_t *src, Pixel *dst, unsigned width, unsigned height,
+                 unsigned x0, unsigned y0, unsigned x1, unsigned y1)
+{
+    perf_scope timed(PERF_HQX);
+    const unsigned dst_linesize = N * width;
+    for (unsigned y = y0; y < y1; ++y) {
+        const uint8_t *cur = src + y * width;
+        const uint8_t *prev = y > 0          ? cur - width : cur;
+        const uint8_t *next = y < height - 1 ? cur + width : cur;
+        filter_span<N>(prev, cur, next, width, x0, x1, dst + y * N * dst_linesize + x0 * N, dst_linesize);
+    }
+}
+
+template <unsigned N, typename Pixel>
+void filter(thread_pool &pool, const uint8_t *src, Pixel *dst, unsigned width, unsigned height)
+{
+    const unsigned bands = pool.size();
+    pool.run(bands, [=](unsigned band) {
+        filter_rect<N>(src, dst, width, height, 0, height * band / bands, width, height * (band + 1) / bands);
+    });
+}
+
+void hqx_filter_rect(const uint8_t *src, YUV_pixel *dst, unsigned width, unsigned height,
+                     unsigned x0, unsigned y0, unsigned x1, unsigned y1)
+{
+    filter_rect<4>(src, dst, width, height, x0, y0, x1, y1);
+}
+
+void hqx_filter_rect(const uint8_t *src, uint32_t *dst, unsigned width, unsigned height,
+                     unsigned x0, unsigned y0, unsigned x1, unsigned y1)
+{
+    filter_rect<4>(src, dst, width, height, x0, y0, x1, y1);
+}
+
+void hqx_filter_rows(const uint8_t *src, YUV_pixel *dst, unsigned width, unsigned height, unsigned y0, unsigned y1)
+{
+    filter_rect<4>(src, dst, width, height, 0, y0, width, y1);
+}
+
+void hqx_filter_rows(const uint8_t *src, uint32_t *dst, unsigned width, unsigned height, unsigned y0, unsigned y1)
+{
+    filter_rect<4>(src, dst, width, height, 0, y0, width, y1);
+}
+
+void hqx_filter(const uint8_t *src, YUV_pixel *dst, unsigned width, unsigned height)
+{
+    filter_rect<4>(src, dst, width, height, 0, 0, width, height);
+}
+
+void hqx_filter(const uint8_t *src, uint32_t *dst, unsigned width, unsigned height)
+{
+    filter_rect<4>(src, dst, width, height, 0, 0, width, height);
+}
+
+void hqx_filter(thread_pool &pool, const uint8_t *src, YUV_pixel *dst, unsigned width, unsigned height)
+{
+    filter<4>(pool, src, dst, width, height);
+}
+
+void hqx_filter(thread_pool &pool, const uint8_t *src, uint32_t *dst, unsigned width, unsigned height)
+{
+    filter<4>(pool, src, dst, width, height);
+}
+
+void hqx_filter_line(const uint8_t *prev, const uint8_t *cur, const uint8_t *next, unsigned width,
+                     uint32_t *dst, unsigned pitch)
+{
+    perf_scope timed(PERF_HQX);
+    filter_span<4>(prev, cur, next, width, 0, width, dst, pitch);
+}
+
+void hqx_filter_span(const uint8_t *prev, const uint8_t *cur, const uint8_t *next, unsigned width,
+                     unsigned x0, unsigned x1, uint32_t *dst, unsigned pitch)
+{
+    perf_scope timed(PERF_HQX);
+    filter_span<4>(prev, cur, next, width, x0, x1, dst, pitch);
+}
+
+void hqx_filter_ref(const uint8_t *src, YUV_pixel *dst, unsigned width, unsigned height)
+{
+    filter_ref<4>(src, dst, width, height);
+}
+
+template <unsigned N>
+void hqx_filter(const uint8_t *src, YUV_pixel *dst, unsigned width, unsigned height)
+{
+    filter_rect<N>(src, dst, width, height, 0, 0, width, height);
+}
+
+template <unsigned N>
+void hqx_filter(const uint8_t *src, uint32_t *dst, unsigned width, unsigned height)
+{
+    filter_rect<N>(src, dst, width, height, 0, 0, width, height);
+}
+
+template <unsigned N>
+void hqx_filter_rect(const uint8_t *src, YUV_pixel *dst, unsigned width, unsigned height,
+                     unsigned x0, unsigned y0, unsigned x1, unsigned y1)
+{
+    filter_rect<N>(src, dst, width, height, x0, y0, x1, y1);
+}
+
+template <unsigned N>
+void hqx_filter_rect(const uint8_t *src, uint32_t *dst, unsigned width, unsigned height,
+                     unsigned x0, unsigned y0, unsigned x1, unsigned y1)
+{
+    filter_rect<N>(src, dst, width, height, x0, y0, x1, y1);
+}
+
+template <unsigned N>
+void hqx_filter_span(const uint8_t *prev, const uint8_t *cur, const uint8_t *next, unsigned width,
+                     unsigned x0, unsigned x1, uint32_t *dst, unsigned pitch)
+{
+    perf_scope timed(PERF_HQX);
+    filter_span<N>(prev, cur, next, width, x0, x1, dst, pitch);
+}
+
+template <unsigned N>
+void hqx_filter(thread_pool &pool, const uint8_t *src, YUV_pixel *dst, unsigned width, unsigned height)
+{
+    filter<N>(pool, src, dst, width, height);
+}
+
+template <unsigned N>
+void hqx_filter(thread_pool &pool, const uint8_t *src, uint32_t *dst, unsigned width, unsigned height)
+{
+    filter<N>(pool, src, dst, width, height);
+}
+
+template <unsigned N>
+void hqx_filter_ref(const uint8_t *src, YUV_pixel *dst, unsigned width, unsigned height)
+{
+    filter_ref<N>(src, dst, width, height);
+}
+
+/* the counted keys of every quadrant through the rules: each key took one
+ * branch of each of the quadrant's PIXELS rules */
+template <unsigned N>
+static std::vector<hqx_rule_branch> rule_branches()
+{
+    typedef hqx_layout<N> layout;
+    static uint64_t keys[4][1 << 11];
+    perf_key_totals(keys);
+    std::map<uint32_t, uint64_t> taken; // rule << 24 | op << 12 | pixels
+    for (unsigned q = 0; q < 4; ++q) {
+        for (unsigned k = 0; k < (1 << 11); ++k) {
+            if (!keys[q][k])
+                continue;
+            for (unsigned r = 0; r < layout::PIXELS; ++r) {
+                const hqx_blend b = layout::rules[q][r](k & 0xff, k >> 8);
+                taken[r << 24 | b.op << 12 | b.i[0] << 8 | b.i[1] << 4 | b.i[2]] += keys[q][k];
+            }
+        }
+    }
+    std::vector<hqx_rule_branch> branches;
+    for (const auto &t : taken) {
+        const unsigned op = t.first >> 12 & 0xff;
+        hqx_rule_branch b = {layout::names[t.first >> 24],
+                             {hqx_weights[op][0], hqx_weights[op][1], hqx_weights[op][2]},
+                             {uint8_t(t.first >> 8 & 0xf), uint8_t(t.first >> 4 & 0xf), uint8_t(t.first & 0xf)},
+                             t.second};
+        branches.push_back(b);
+    }
+    std::stable_sort(branches.begin(), branches.end(),
+                     [](const hqx_rule_branch &a, const hqx_rule_branch &b) {return a.count > b.count;});
+    return branches;
+}
+
+std::vector<hqx_rule_branch> hqx_rule_branches(unsigned scale)
+{
+    switch (scale) {
+    case 2:
+        return rule_branches<2>();
+    case 3:
+        return rule_branches<3>();
+    case 4:
+        return rule_branches<4>();
+    }
+    return std::vector<hqx_rule_branch>();
+}
+
+#define HQX_SCALE(N) \
+    template void hqx_filter<N>(const uint8_t *, YUV_pixel *, unsigned, unsigned); \
+    template void hqx_filter<N>(const uint8_t *, uint32_t *, unsigned, unsigned); \
+    template void hqx_filter_rect<N>(const uint8_t *, YUV_pixel *, unsigned, unsigned, \
+                                     unsigned, unsigned, unsigned, unsigned); \
+    template void hqx_filter_rect<N>(const uint8_t *, uint32_t *, unsigned, unsigned, \
+                                     unsigned, unsigned, unsigned, unsigned); \
+    template void hqx_filter_span<N>(const uint8_t *, const uint8_t *, const uint8_t *, unsigned, \
+                                     unsigned, unsigned, uint32_t *, unsigned); \
+    template void hqx_filter<N>(thread_pool &, const uint8_t *, YUV_pixel *, unsigned, unsigned); \
+    template void hqx_filter<N>(thread_pool &, const uint8_t *, uint32_t *, unsigned, unsigned); \
+    template void hqx_filter_ref<N>(const uint8_t *, YUV_pixel *, unsigned, unsigned);
+
+HQX_SCALE(2)
+HQX_SCALE(3)
+HQX_SCALE(4)
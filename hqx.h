@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "colors.h"
+
+class thread_pool;
+
+/* builds the blend tables of all scale factors, call after color_init() */
+void hqx_init();
+
+/* 4x upscale of palette indexed src into dst (4*width x 4*height), either as
+ * YUV or straight as ARGB8888 display pixels from the blended palette */
+void hqx_filter(const uint8_t *src, YUV_pixel *dst, unsigned width, unsigned height);
+void hqx_filter(const uint8_t *src, uint32_t *dst, unsigned width, unsigned height);
+
+/* hqx_filter of the source rows [y0, y1) only, the rows around them are still
+ * read as neighbours */
+void hqx_filter_rows(const uint8_t *src, YUV_pixel *dst, unsigned width, unsigned height, unsigned y0, unsigned y1);
+void hqx_filter_rows(const uint8_t *src, uint32_t *dst, unsigned width, unsigned height, unsigned y0, unsigned y1);
+
+/* hqx_filter of the source rectangle [x0, x1) x [y0, y1) only */
+void hqx_filter_rect(const uint8_t *src, YUV_pixel *dst, unsigned width, unsigned height,
+                     unsigned x0, unsigned y0, unsigned x1, unsigned y1);
+void hqx_filter_rect(const uint8_t *src, uint32_t *dst, unsigned width, unsigned height,
+                     unsigned x0, unsigned y0, unsigned x1, unsigned y1);
+
+/* one source line given the lines above and below it (pass cur again at the
+ * frame edges), writes 4 ARGB output lines pitch pixels apart */
+void hqx_filter_line(const uint8_t *prev, const uint8_t *cur, const uint8_t *next, unsigned width,
+                     uint32_t *dst, unsigned pitch);
+
+/* hqx_filter_line of the source pixels [x0, x1) only, dst is the output of x0 */
+void hqx_filter_span(const uint8_t *prev, const uint8_t *cur, const uint8_t *next, unsigned width,
+                     unsigned x0, unsigned x1, uint32_t *dst, unsigned pitch);
+
+/* hqx_filter split into row bands over the pool threads, same output */
+void hqx_filter(thread_pool &pool, const uint8_t *src, YUV_pixel *dst, unsigned width, unsigned height);
+void hqx_filter(thread_pool &pool, const uint8_t *src, uint32_t *dst, unsigned width, unsigned height);
+
+/* same result as hqx_filter, evaluates the rule functions for every pixel */
+void hqx_filter_ref(const uint8_t *src, YUV_pixel *dst, unsigned width, unsigned height);
+
+/* A branch of one of the rules (hq4x_rule_2x2_00 etc.): the blend it
+ * returns, in the window of the top-left quadrant, and the output pixels it
+ * produced while perf_count_rules was set (see perf.h). */
+struct hqx_rule_branch {
+    const char *rule;
+    uint8_t weights[3]; // sixteenths
+    uint8_t pixels[3];  // 3x3 window indices the weights apply to
+    uint64_t count;
+};
+
+/* the branches taken by the rules of scale factor scale, most taken first;
+ * the counts hold for frames filtered at that factor only */
+std::vector<hqx_rule_branch> hqx_rule_branches(unsigned scale);
+
+/* The filters at scale factor N: 2 (hq2x), 3 (hq3x) or 4 (hq4x, same as the
+ * functions above), dst is N times the source in both directions. Every
+ * factor has its own rule set and tables, nothing is computed at 4x and
+ * scaled down. */
+template <unsigned N>
+void hqx_filter(const uint8_t *src, YUV_pixel *dst, unsigned width, unsigned height);
+template <unsigned N>
+void hqx_filter(const uint8_t *src, uint32_t *dst, unsigned width, unsigned height);
+template <unsigned N>
+void hqx_filter_rect(const uint8_t *src, YUV_pixel *dst, unsigned width, unsigned height,
+                     unsigned x0, unsigned y0, unsigned x1, unsigned y1);
+template <unsigned N>
+void hqx_filter_rect(const uint8_t *src, uint32_t *dst, unsigned width, unsigned height,
+                     unsigned x0, unsigned y0, unsigned x1, unsigned y1);
+template <unsigned N>
+void hqx_filter_span(const uint8_t *prev, const uint8_t *cur, const uint8_t *next, unsigned width,
+                     unsigned x0, unsigned x1, uint32_t *dst, unsigned pitch);
+template <unsigned N>
+void hqx_filter(thread_pool &pool, const uint8_t *src, YUV_pixel *dst, unsigned width, unsigned height);
+template <unsigned N>
+void hqx_filter(thread_pool &pool, const uint8_t *src, uint32_t *dst, unsigned width, unsigned height);
+template <unsigned N>
+void hqx_filter_ref(const uint8_t *src, YUV_pixel *dst, unsigned width, unsigned height);
@@ -0,0 +1,766 @@
+/* Differential checker for the hqx kernels: every kernel is compared pixel
+ * by pixel against hqx_filter_ref() of its scale factor on the bundled
+ * screens and on all 3x3 neighbourhoods over a small alphabet, and the
+ * reference output of every screen is checked against stored golden
+ * checksums. */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "colors.h"
+#include "hqx.h"
+#include "pipeline.h"
+#include "snapshot.h"
+#include "thread_pool.h"
+#include "tile_cache.h"
+#include "tile_stream.h"
+#include "zxscreen.h"
+
+const unsigned SRC_W = MAXX*8, SRC_H = MAXY*8;
+
+typedef std::function<void(const uint8_t *, YUV_pixel *, unsigned, unsigned)> yuv_fn;
+typedef std::function<void(const uint8_t *, uint32_t *, unsigned, unsigned)> argb_fn;
+
+struct yuv_kernel {
+    const char *name;
+    yuv_fn run;
+};
+
+struct argb_kernel {
+    const char *name;
+    argb_fn run;
+};
+
+/* kernels working from the screen memory, checked on the screens only */
+typedef std::function<void(const uint8_t *, uint32_t *)> screen_fn;
+
+struct screen_kernel {
+    const char *name;
+    screen_fn run;
+};
+
+/* kernels rendering the screen with the border, given its colour per line */
+typedef std::function<void(const uint8_t *, const uint8_t *, uint32_t *)> border_fn;
+
+struct border_kernel {
+    const char *name;
+    border_fn run;
+};
+
+static bool same(const YUV_pixel &a, const YUV_pixel &b) {return a.y == b.y && a.u == b.u && a.v == b.v;}
+static bool same(uint32_t a, uint32_t b) {return a == b;}
+static void print(const YUV_pixel &p) {printf("yuv(%d, %d, %d)", p.y, p.u, p.v);}
+static void print(uint32_t p) {printf("argb(%08x)", p);}
+
+/* reports the first differing pixel, returns true if all match */
+template <typename Pixel>
+static bool compare(const char *kernel, const char *input, const std::vector<Pixel> &ref,
+                    const std::vector<Pixel> &out, unsigned width, unsigned scale = 4)
+{
+    for (size_t i = 0; i < ref.size(); ++i) {
+        if (same(ref[i], out[i]))
+            continue;
+        printf("%s: %s differs at (%u, %u) (source %u, %u): expected ", kernel, input,
+               unsigned(i % width), unsigned(i / width), unsigned(i % width / scale), unsigned(i / width / scale));
+        print(ref[i]);
+        printf(", got ");
+        print(out[i]);
+        printf("\n");
+        return false;
+    }
+    return true;
+}
+
+static uint64_t fnv1a(const uint32_t *p, size_t n)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < n; ++i)
+        for (unsigned b = 0; b < 32; b += 8) {
+            h ^= (p[i] >> b) & 0xff;
+            h *= 0x100000001b3ull;
+        }
+    return h;
+}
+
+typedef void (*ref_fn)(const uint8_t *, YUV_pixel *, unsigned, unsigned);
+
+struct checker {
+    unsigned scale;
+    ref_fn ref;
+    std::vector<yuv_kernel> yuv_kernels;
+    std::vector<argb_kernel> argb_kernels;
+    std::vector<screen_kernel> screen_kernels;
+    std::vector<border_kernel> border_kernels;
+    unsigned failures;
+    uint64_t sum;   // of the last screen, see check_screen()
+
+    checker(unsigned scale, ref_fn ref) : scale(scale), ref(ref), failures(0), sum(0) {}
+
+    unsigned kernels() const {
+        return yuv_kernels.size() + argb_kernels.size() + screen_kernels.size() + border_kernels.size();
+    }
+
+    /* runs all kernels on src, returns the reference output as ARGB */
+    std::vector<uint32_t> check(const uint8_t *src, unsigned width, unsigned height, const char *input) {
+        const unsigned n = width * scale * height * scale;
+        std::vector<YUV_pixel> ref(n), yuv(n);
+        std::vector<uint32_t> ref_argb(n), argb(n);
+        this->ref(src, ref.data(), width, height);
+        for (unsigned i = 0; i < n; ++i) {
+            RGB_pixel rgb;
+            yuv2rgb(rgb, ref[i]);
+            ref_argb[i] = rgb2argb(rgb);
+        }
+        for (const yuv_kernel &k : yuv_kernels) {
+            std::fill(yuv.begin(), yuv.end(), YUV_pixel{0xffff, -1, -1});
+            k.run(src, yuv.data(), width, height);
+            failures += !compare(k.name, input, ref, yuv, width * scale, scale);
+        }
+        for (const argb_kernel &k : argb_kernels) {
+            std::fill(argb.begin(), argb.end(), 0);
+            k.run(src, argb.data(), width, height);
+            failures += !compare(k.name, input, ref_argb, argb, width * scale, scale);
+        }
+        return ref_argb;
+    }
+};
+
+/* the frame filtered as separate 8x8 cell rectangles, like the viewer's
+ * incremental redraw */
+template <unsigned N, typename Pixel>
+static void by_cells(const uint8_t *src, Pixel *dst, unsigned width, unsigned height)
+{
+    for (unsigned y = 0; y < height; y += 8)
+        for (unsigned x = 0; x < width; x += 8)
+            hqx_filter_rect<N>(src, dst, width, height, x, y, std::min(x + 8, width), std::min(y + 8, height));
+}
+
+/* the kernels of the other scale factors */
+template <unsigned N>
+static void scaled_kernels(checker &c, thread_pool &pool, tile_cache &cache)
+{
+    const zx_scaler *z = zx_scaler_for(N);
+    c.yuv_kernels = {
+        {"table", [](const uint8_t *s, YUV_pixel *d, unsigned w, unsigned h) {hqx_filter<N>(s, d, w, h);}},
+        {"threaded", [&](const uint8_t *s, YUV_pixel *d, unsigned w, unsigned h) {hqx_filter<N>(pool, s, d, w, h);}},
+        {"cells", by_cells<N, YUV_pixel>},
+    };
+    c.argb_kernels = {
+        {"argb", [](const uint8_t *s, uint32_t *d, unsigned w, unsigned h) {hqx_filter<N>(s, d, w, h);}},
+        {"argb_threaded", [&](const uint8_t *s, uint32_t *d, unsigned w, unsigned h) {hqx_filter<N>(pool, s, d, w, h);}},
+        {"argb_cells", by_cells<N, uint32_t>},
+        {"tile_cache", [&](const uint8_t *s, uint32_t *d, unsigned w, unsigned h) {cache.render(s, w, h, d);}},
+    };
+    c.screen_kernels = {
+        {"fused", [=](const uint8_t *scr, uint32_t *d) {
+            z->hqx(scr, scr + SRC_H * MAXX, d, SRC_W * N, 0, SRC_H, 0);
+        }},
+        {"fused_threaded", [=, &pool](const uint8_t *scr, uint32_t *d) {
+            z->hqx_pool(pool, scr, scr + SRC_H * MAXX, d, SRC_W * N, 0);
+        }},
+    };
+    c.border_kernels = {
+        {"border", [=](const uint8_t *scr, const uint8_t *border, uint32_t *d) {
+            z->border_hqx(scr, scr + SRC_H * MAXX, border, d, ZX_BORDER_W * N, 0, ZX_BORDER_H, 0);
+        }},
+        {"border_threaded", [=, &pool](const uint8_t *scr, const uint8_t *border, uint32_t *d) {
+            z->border_hqx_pool(pool, scr, scr + SRC_H * MAXX, border, d, ZX_BORDER_W * N, 0);
+        }},
+    };
+}
+
+/* all kernels on a screen and on the screen with a border, the checksum of
+ * the reference output of the screen is left in c.sum */
+static void check_screen(checker &c, const uint8_t *scr, const uint8_t *fb, unsigned index, const std::string &name)
+{
+    std::vector<uint32_t> ref = c.check(fb, SRC_W, SRC_H, name.c_str());
+    std::vector<uint32_t> out(ref.size());
+    for (const screen_kernel &k : c.screen_kernels) {
+        std::fill(out.begin(), out.end(), 0);
+        k.run(scr, out.data());
+        c.failures += !compare(k.name, name.c_str(), ref, out, SRC_W * c.scale, c.scale);
+    }
+    c.sum = fnv1a(ref.data(), ref.size());
+    // a plain border and loading stripes, changing colour every 3 lines
+    std::vector<uint8_t> frame(ZX_BORDER_W * ZX_BORDER_H);
+    for (unsigned striped = 0; striped < 2; ++striped) {
+        uint8_t border[ZX_BORDER_H];
+        for (unsigned y = 0; y < ZX_BORDER_H; ++y)
+            border[y] = striped ? (y / 3 + index) % 8 : index % 8;
+        for (unsigned y = 0; y < ZX_BORDER_H; ++y)
+            zx_decode_border_line(scr, scr + SRC_H * MAXX, border, y, &frame[y * ZX_BORDER_W]);
+        const std::string input = name + (striped ? " with striped border" : " with border");
+        ref = c.check(frame.data(), ZX_BORDER_W, ZX_BORDER_H, input.c_str());
+        out.resize(ref.size());
+        for (const border_kernel &k : c.border_kernels) {
+            std::fill(out.begin(), out.end(), 0);
+            k.run(scr, border, out.data());
+            c.failures += !compare(k.name, input.c_str(), ref, out, ZX_BORDER_W * c.scale, c.scale);
+        }
+    }
+}
+
+/* The screen decoders of the selected SIMD level against
+ * get_sinclair_color() in both flash phases, returns true if all match. */
+static bool check_decode(const uint8_t *scr, const std::string &name, const char *level)
+{
+    const uint8_t *attr = scr + SRC_H * MAXX;
+    std::vector<uint8_t> fb(SRC_W * SRC_H), line(ZX_BORDER_W);
+    uint8_t border[ZX_BORDER_H];
+    for (unsigned y = 0; y < ZX_BORDER_H; ++y)
+        border[y] = y / 3 % 8;
+    for (unsigned flash = 0; flash < 2; ++flash) {
+        zx_decode(scr, attr, fb.data(), flash);
+        for (unsigned y = 0; y < SRC_H; ++y) {
+            zx_decode_line(scr, attr, y, line.data(), flash);
+            for (unsigned x = 0; x < SRC_W; ++x) {
+                const unsigned ref = get_sinclair_color(scr, attr, x, y, flash);
+                const char *decoder = fb[y * SRC_W + x] != ref ? "zx_decode" : line[x] != ref ? "zx_decode_line" : NULL;
+                if (decoder) {
+                    printf("%s_%s: %s differs at (%u, %u) in flash phase %u\n", decoder, level, name.c_str(), x, y,
+                           flash);
+                    return false;
+                }
+            }
+        }
+        for (unsigned y = 0; y < ZX_BORDER_H; ++y) {
+            zx_decode_border_line(scr, attr, border, y, line.data(), flash);
+            for (unsigned x = 0; x < ZX_BORDER_W; ++x) {
+                const unsigned px = x - ZX_BORDER_LEFT, py = y - ZX_BORDER_TOP;
+                const unsigned ref = px < SRC_W && py < SRC_H ? get_sinclair_color(scr, attr, px, py, flash) : border[y];
+                if (line[x] != ref) {
+                    printf("zx_decode_border_line_%s: %s differs at (%u, %u) in flash phase %u\n", level,
+                           name.c_str(), x, y, flash);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/* a Spectrum file as zx_load_screen() reads it, by its extension */
+struct screen_file {
+    const char *name;
+    std::vector<uint8_t> data;
+    int border; // the one it was saved with, -1 if the format has none
+};
+
+static void put_word(std::vector<uint8_t> &v, size_t at, unsigned w)
+{
+    v[at] = w & 0xff;
+    v[at + 1] = w >> 8;
+}
+
+/* .z80 run length coding: runs of 5 or more, and of 2 or more 0xed, become
+ * ED ED n b; a single 0xed takes the byte after it along as a literal */
+static std::vector<uint8_t> z80_rle(const std::vector<uint8_t> &src)
+{
+    std::vector<uint8_t> out;
+    for (size_t i = 0; i < src.size();) {
+        size_t run = 1;
+        while (i + run < src.size() && run < 255 && src[i + run] == src[i])
+            ++run;
+        if (run >= 5 || (src[i] == 0xed && run >= 2)) {
+            out.insert(out.end(), {0xed, 0xed, uint8_t(run), src[i]});
+            i += run;
+        } else if (src[i] == 0xed) {
+            out.insert(out.end(), src.begin() + i, src.begin() + std::min(i + 2, src.size()));
+            i += 2;
+        } else {
+            out.push_back(src[i++]);
+        }
+    }
+    return out;
+}
+
+/* version 1 .z80: 30 byte header (PC not 0) and the 48K from 0x4000 */
+static std::vector<uint8_t> z80_v1(const std::vector<uint8_t> &ram, uint8_t border, bool compressed)
+{
+    const std::vector<uint8_t> data = compressed ? z80_rle(ram) : ram;
+    std::vector<uint8_t> f(30 + data.size());
+    put_word(f, 6, 0x8000);
+    f[12] = border << 1 | (compressed ? 0b100000 : 0);
+    std::copy(data.begin(), data.end(), f.begin() + 30);
+    // compressed data ends with an end marker
+    if (compressed)
+        f.insert(f.end(), {0x00, 0xed, 0xed, 0x00});
+    return f;
+}
+
+/* version 2 (extra 23) or 3 (extra 54) .z80: the pages in the order given,
+ * compressed but for the stored one */
+static std::vector<uint8_t> z80_paged(unsigned extra, uint8_t mode, uint8_t port, uint8_t border,
+                                      const std::vector<uint8_t> *banks, const std::vector<unsigned> &pages,
+                                      unsigned stored)
+{
+    std::vector<uint8_t> f(32 + extra);
+    f[12] = border << 1;
+    put_word(f, 30, extra);
+    put_word(f, 32, 0x8000);
+    f[34] = mode;
+    f[35] = port;
+    for (unsigned page : pages) {
+        const std::vector<uint8_t> &bank = banks[page - 3];
+        const std::vector<uint8_t> data = page == stored ? bank : z80_rle(bank);
+        const size_t at = f.size();
+        f.resize(at + 3);
+        put_word(f, at, page == stored ? 0xffff : data.size());
+        f[at + 2] = page;
+        f.insert(f.end(), data.begin(), data.end());
+    }
+    return f;
+}
+
+/* .sna: 27 byte header and the 48K from 0x4000 (banks 5, 2 and the paged
+ * one), 128K ones go on with PC, the 0x7ffd port value, the TR-DOS flag and
+ * the other banks in ascending order */
+static std::vector<uint8_t> sna(const std::vector<uint8_t> *banks, uint8_t border, int port)
+{
+    const unsigned paged = port < 0 ? 0 : port & 0b111;
+    std::vector<uint8_t> f(27);
+    f[26] = border;
+    for (unsigned bank : {5u, 2u, paged})
+        f.insert(f.end(), banks[bank].begin(), banks[bank].end());
+    if (port < 0)
+        return f;
+    f.insert(f.end(), {0x00, 0x80, uint8_t(port), 0});
+    for (unsigned bank = 0; bank < 8; ++bank)
+        if (bank != 5 && bank != 2 && bank != paged)
+            f.insert(f.end(), banks[bank].begin(), banks[bank].end());
+    return f;
+}
+
+/* .tap block: length, flag, payload and the xor of both as checksum */
+static void tap_block(std::vector<uint8_t> &f, uint8_t flag, const uint8_t *payload, size_t n)
+{
+    const size_t at = f.size();
+    f.resize(at + 2);
+    put_word(f, at, n + 2);
+    f.push_back(flag);
+    f.insert(f.end(), payload, payload + n);
+    uint8_t sum = flag;
+    for (size_t i = 0; i < n; ++i)
+        sum ^= payload[i];
+    f.push_back(sum);
+}
+
+/* header block: type, 10 character name, data length and 2 parameters (the
+ * start address of CODE) */
+static void tap_header(std::vector<uint8_t> &f, uint8_t type, const char *name, unsigned length, unsigned param)
+{
+    std::vector<uint8_t> h(17, ' ');
+    h[0] = type;
+    memcpy(&h[1], name, std::min<size_t>(strlen(name), 10));
+    put_word(h, 11, length);
+    put_word(h, 13, param);
+    put_word(h, 15, 0x8000);
+    tap_block(f, 0x00, h.data(), h.size());
+}
+
+/* The screen wrapped in .sna, .z80 and .tap files the way emulators save
+ * them, with its inverse wherever a wrong bank or block would be read:
+ * each must load as the same 6912 bytes. The files are written to dir,
+ * returns true if all load right. */
+static bool check_screen_files(const uint8_t *scr, const std::string &name, const std::string &dir)
+{
+    std::vector<uint8_t> screen(scr, scr + ZX_SCREEN_SIZE), decoy(ZX_SCREEN_SIZE);
+    for (unsigned i = 0; i < ZX_SCREEN_SIZE; ++i)
+        decoy[i] = ~scr[i];
+    // 128K of banks, each filled with its own number, and the 48K from 0x4000
+    std::vector<uint8_t> banks[8], shadow[8];
+    for (unsigned b = 0; b < 8; ++b)
+        banks[b].assign(16384, 0x30 + b);
+    std::copy(screen.begin(), screen.end(), banks[5].begin());
+    std::copy(decoy.begin(), decoy.end(), banks[7].begin());
+    for (unsigned b = 0; b < 8; ++b)
+        shadow[b] = banks[b];
+    std::copy(decoy.begin(), decoy.end(), shadow[5].begin());
+    std::copy(screen.begin(), screen.end(), shadow[7].begin());
+    std::vector<uint8_t> ram48;
+    for (unsigned b : {5u, 2u, 0u})
+        ram48.insert(ram48.end(), banks[b].begin(), banks[b].end());
+
+    std::vector<screen_file> files = {
+        {"48k.sna", sna(banks, 1, -1), 1},
+        {"128k.sna", sna(banks, 2, 0), 2},
+        // the shadow screen is bank 7, at 0xc000 if paged in, else the last bank after the header
+        {"128k_shadow.sna", sna(shadow, 3, 0b1000 | 1), 3},
+        {"128k_shadow_paged.sna", sna(shadow, 4, 0b1000 | 7), 4},
+        {"v1.z80", z80_v1(ram48, 5, false), 5},
+        {"v1_rle.z80", z80_v1(ram48, 6, true), 6},
+        // v2 modes 0 and 1 are 48K machines, 3 and 4 128K ones
+        {"v2_48k.z80", z80_paged(23, 0, 0b1000, 7, banks, {4, 5, 8}, 0), 7},
+        {"v2_128k.z80", z80_paged(23, 3, 0, 0, banks, {3, 4, 5, 6, 7, 8, 9, 10}, 0), 0},
+        {"v2_128k_shadow.z80", z80_paged(23, 3, 0b1000, 1, shadow, {3, 4, 5, 6, 7, 8, 9, 10}, 0), 1},
+        // v3 shifts them: 3 is a 48K machine with an M.G.T. interface, 4 to 6 are 128K ones
+        {"v3_mgt.z80", z80_paged(54, 3, 0b1000, 2, banks, {10, 4, 5, 8}, 0), 2},
+        {"v3_128k_shadow.z80", z80_paged(54, 4, 0b1000, 3, shadow, {3, 4, 5, 6, 7, 8, 9, 10}, 10), 3},
+        {"v3_128k.z80", z80_paged(54, 4, 0, 4, banks, {3, 4, 5, 6, 7, 8, 9, 10}, 8), 4},
+    };
+    std::vector<uint8_t> tap, loader(20, 0xea);
+    // a loader, a headerless block of the wrong data, CODE of the size of a
+    // screen loaded elsewhere and a number array at 16384 before SCREEN$
+    tap_header(tap, 0, "loader", loader.size(), 10);
+    tap_block(tap, 0xff, loader.data(), loader.size());
+    tap_block(tap, 0xff, decoy.data(), decoy.size());
+    tap_header(tap, 3, "code", ZX_SCREEN_SIZE, 32768);
+    tap_block(tap, 0xff, decoy.data(), decoy.size());
+    tap_header(tap, 1, "array", ZX_SCREEN_SIZE, 16384);
+    tap_block(tap, 0xff, decoy.data(), decoy.size());
+    tap_header(tap, 3, "screen", ZX_SCREEN_SIZE, 16384);
+    tap_block(tap, 0xff, screen.data(), screen.size());
+    files.push_back({"screen.tap", tap, -1});
+    // without a SCREEN$ header the first 6912 byte data block is taken
+    std::vector<uint8_t> headerless;
+    tap_header(headerless, 0, "loader", loader.size(), 10);
+    tap_block(headerless, 0xff, loader.data(), loader.size());
+    tap_block(headerless, 0xff, screen.data(), screen.size());
+    tap_block(headerless, 0xff, decoy.data(), decoy.size());
+    files.push_back({"headerless.tap", headerless, -1});
+
+    bool ok = true;
+    for (const screen_file &file : files) {
+        const std::string path = dir + "/" + file.name;
+        FILE *f = fopen(path.c_str(), "wb");
+        if (!f || fwrite(file.data.data(), 1, file.data.size(), f) != file.data.size() || fclose(f) != 0) {
+            perror(path.c_str());
+            return false;
+        }
+        uint8_t loaded[ZX_SCREEN_SIZE], border = 0xff;
+        const bool read = zx_load_screen(path.c_str(), loaded, &border);
+        unlink(path.c_str());
+        if (!read)
+            printf("%s as %s: %s\n", name.c_str(), file.name, strerror(errno));
+        else if (memcmp(loaded, scr, ZX_SCREEN_SIZE) != 0)
+            printf("%s as %s: screen differs at byte %u\n", name.c_str(), file.name,
+                   unsigned(std::mismatch(loaded, loaded + ZX_SCREEN_SIZE, scr).first - loaded));
+        else if (file.border >= 0 && border != file.border)
+            printf("%s as %s: border %u, expected %d\n", name.c_str(), file.name, border, file.border);
+        else
+            continue;
+        ok = false;
+    }
+    return ok;
+}
+
+/* Frames cut from the upscaled screens to a size that is no multiple of
+ * the tile size, so the edge tiles are partial, are coded as a tile delta
+ * stream and decoded again: every decoded frame must equal the one coded.
+ * Among them are empty repeat() frames, unchanged, partly changed and key
+ * frames, and a noise frame only raw tiles can code. */
+static bool check_tile_stream(const std::vector<std::vector<uint8_t> > &screens)
+{
+    const unsigned W = 1000, H = 750, FULL_W = SRC_W * 4;
+    FILE *f = tmpfile();
+    if (!f) {
+        perror("tmpfile");
+        return false;
+    }
+    tile_encoder enc(fileno(f), W, H, 50);
+    std::vector<std::vector<uint32_t> > sent;
+    std::vector<bool> empty, key;   // frames changing no tile, and all of them
+    std::vector<uint32_t> full(FULL_W * SRC_H * 4), frame(W * H);
+    bool ok = true;
+    auto send = [&](bool k) {
+        empty.push_back(!k && !sent.empty() && frame == sent.back());
+        key.push_back(k || sent.empty());
+        sent.push_back(frame);
+        ok &= enc.write(frame.data(), k);
+    };
+    auto again = [&](bool k) {
+        empty.push_back(!k);
+        key.push_back(k);
+        sent.push_back(sent.back());
+        ok &= enc.repeat(k);
+    };
+    for (size_t i = 0; i < screens.size(); ++i) {
+        const uint8_t *scr = screens[i].data();
+        zx_render_hq4x(scr, scr + SRC_H * MAXX, full.data(), FULL_W, 0, SRC_H);
+        for (unsigned y = 0; y < H; ++y)
+            std::copy(&full[y * FULL_W], &full[y * FULL_W] + W, &frame[y * W]);
+        send(i % 5 == 4);
+        again(false);
+        send(false);
+        // a sprite sized block moved in, straddling tiles and the right edge
+        const unsigned x0 = W - 50 - i * 37 % 200, y0 = 20 + i * 53 % (H - 100);
+        for (unsigned y = y0; y < y0 + 70; ++y)
+            for (unsigned x = x0; x < W; ++x)
+                frame[y * W + x] = full[(y + 11) * FULL_W + x - 23];
+        send(false);
+    }
+    uint32_t noise = 1;
+    for (uint32_t &p : frame) {
+        noise ^= noise << 13;
+        noise ^= noise >> 17;
+        noise ^= noise << 5;
+        p = noise | 0xff000000u;
+    }
+    send(false);
+    again(true);
+    if (!ok) {
+        perror("tile stream");
+        fclose(f);
+        return false;
+    }
+
+    rewind(f);
+    tile_decoder dec(f);
+    if (!dec.ok() || dec.width != W || dec.height != H) {
+        printf("tile stream: bad header\n");
+        fclose(f);
+        return false;
+    }
+    for (size_t i = 0; i < sent.size() && ok; ++i) {
+        const int got = dec.next();
+        const size_t tiles = dec.changed().size();
+        if (got != 1)
+            printf("tile stream: frame %u of %u %s\n", unsigned(i), unsigned(sent.size()),
+                   got ? "is corrupt" : "is missing");
+        else if (!std::equal(sent[i].begin(), sent[i].end(), dec.frame()))
+            printf("tile stream: frame %u differs at pixel %u\n", unsigned(i),
+                   unsigned(std::mismatch(sent[i].begin(), sent[i].end(), dec.frame()).first - sent[i].begin()));
+        else if ((empty[i] && tiles) || (key[i] && tiles != dec.columns * dec.rows))
+            printf("tile stream: frame %u changes %u tiles\n", unsigned(i), unsigned(tiles));
+        else
+            continue;
+        ok = false;
+    }
+    if (ok && dec.next() != 0) {
+        printf("tile stream: data after the last frame\n");
+        ok = false;
+    }
+    // every coding is decoded at least once
+    for (unsigned c = TILE_FILL; c <= TILE_RAW && ok; ++c)
+        if (!enc.coded[c]) {
+            printf("tile stream: no tile coded as %u\n", c);
+            ok = false;
+        }
+    fclose(f);
+    return ok;
+}
+
+/* Every 3x3 window over the alphabet is tiled into test images, so the
+ * center of each tile sees exactly that neighbourhood. The alphabet has 0
+ * and 8 which diff() treats as equal plus 3 other colours, enough for
+ * every combination of pattern and edge diffs. */
+static void exhaustive(checker &c)
+{
+    static const uint8_t alphabet[] = {0, 8, 3, 12, 7};
+    const unsigned symbols = sizeof(alphabet), windows = 5*5*5*5*5*5*5*5*5;
+    const unsigned per_row = 64, rows = 64, per_image = per_row * rows;
+    std::vector<uint8_t> src(per_row * 3 * rows * 3);
+    for (unsigned first = 0; first < windows; first += per_image) {
+        const unsigned count = std::min(per_image, windows - first);
+        std::fill(src.begin(), src.end(), 0);
+        for (unsigned t = 0; t < count; ++t) {
+            unsigned code = first + t;
+            const unsigned tx = t % per_row * 3, ty = t / per_row * 3;
+            for (unsigned i = 0; i < 9; ++i, code /= symbols)
+                src[(ty + i / 3) * per_row * 3 + tx + i % 3] = alphabet[code % symbols];
+        }
+        char input[64];
+        snprintf(input, sizeof(input), "hq%ux windows %u..%u", c.scale, first, first + count - 1);
+        unsigned before = c.failures;
+        c.check(src.data(), per_row * 3, rows * 3, input);
+        if (c.failures != before)
+            return;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    bool update = false, windows = true;
+    std::string golden_path;
+    int opt;
+    while ((opt = getopt(argc, argv, "ug:q")) != -1) {
+        switch (opt) {
+        case 'u':
+            update = true;
+            break;
+        case 'g':
+            golden_path = optarg;
+            break;
+        case 'q':
+            windows = false;
+            break;
+        default:
+            fprintf(stderr, "usage: hqxcheck [-u] [-q] [-g golden] [screens dir]\n");
+            return -1;
+        }
+    }
+    const char *dir_path = optind < argc ? argv[optind] : "screens";
+    // the checksums are kept next to the screens they are of
+    if (golden_path.empty())
+        golden_path = std::string(dir_path) + "/hq4x.golden";
+
+    color_init();
+    hqx_init();
+    thread_pool pool(4);
+    tile_cache cache;
+
+    checker c(4, hqx_filter_ref);
+    c.yuv_kernels = {
+        {"table", [](const uint8_t *s, YUV_pixel *d, unsigned w, unsigned h) {hqx_filter(s, d, w, h);}},
+        {"threaded", [&](const uint8_t *s, YUV_pixel *d, unsigned w, unsigned h) {hqx_filter(pool, s, d, w, h);}},
+        {"cells", by_cells<4, YUV_pixel>},
+    };
+    c.argb_kernels = {
+        {"argb", [](const uint8_t *s, uint32_t *d, unsigned w, unsigned h) {hqx_filter(s, d, w, h);}},
+        {"argb_threaded", [&](const uint8_t *s, uint32_t *d, unsigned w, unsigned h) {hqx_filter(pool, s, d, w, h);}},
+        {"argb_cells", by_cells<4, uint32_t>},
+        // kept across inputs, so later ones are mostly assembled from hits
+        {"tile_cache", [&](const uint8_t *s, uint32_t *d, unsigned w, unsigned h) {cache.render(s, w, h, d);}},
+    };
+    // the bulk YUV to ARGB conversion at every level the CPU has
+    const std::string best = simd_level();
+    std::deque<std::string> level_names;
+    std::vector<const char *> decode_levels;
+    for (const char *const *level = simd_levels; *level; ++level) {
+        if (!simd_select(*level))
+            continue;
+        decode_levels.push_back(*level);
+        level_names.push_back(std::string("yuv2argb_") + *level);
+        const std::string name = *level;
+        c.argb_kernels.push_back({level_names.back().c_str(), [=](const uint8_t *s, uint32_t *d, unsigned w, unsigned h) {
+            std::vector<YUV_pixel> yuv(w * 4 * h * 4);
+            hqx_filter(s, yuv.data(), w, h);
+            simd_select(name.c_str());
+            yuv2argb(yuv.data(), d, yuv.size());
+            simd_select(best.c_str());
+        }});
+    }
+    simd_select(best.c_str());
+    c.screen_kernels = {
+        {"fused", [](const uint8_t *scr, uint32_t *d) {
+            zx_render_hq4x(scr, scr + SRC_H * MAXX, d, SRC_W * 4, 0, SRC_H);
+        }},
+        {"fused_threaded", [&](const uint8_t *scr, uint32_t *d) {
+            zx_render_hq4x(pool, scr, scr + SRC_H * MAXX, d, SRC_W * 4);
+        }},
+    };
+    c.border_kernels = {
+        {"border", [](const uint8_t *scr, const uint8_t *border, uint32_t *d) {
+            zx_render_border_hq4x(scr, scr + SRC_H * MAXX, border, d, ZX_BORDER_W * 4, 0, ZX_BORDER_H);
+        }},
+        {"border_threaded", [&](const uint8_t *scr, const uint8_t *border, uint32_t *d) {
+            zx_render_border_hq4x(pool, scr, scr + SRC_H * MAXX, border, d, ZX_BORDER_W * 4);
+        }},
+    };
+
+    // hq2x and hq3x, golden checksums under "hq2x:name" and "hq3x:name"
+    checker c2(2, hqx_filter_ref<2>), c3(3, hqx_filter_ref<3>);
+    tile_cache cache2(2048, 2), cache3(2048, 3);
+    scaled_kernels<2>(c2, pool, cache2);
+    scaled_kernels<3>(c3, pool, cache3);
+    checker *const checkers[] = {&c, &c2, &c3};
+
+    std::map<std::string, uint64_t> golden;
+    if (FILE *f = fopen(golden_path.c_str(), "r")) {
+        char name[256];
+        unsigned long long h;
+        while (fscanf(f, "%255s %llx", name, &h) == 2)
+            golden[name] = h;
+        fclose(f);
+    }
+
+    std::vector<std::string> names;
+    if (DIR *dir = opendir(dir_path)) {
+        while (struct dirent *e = readdir(dir)) {
+            std::string name = e->d_name;
+            if (name.size() > 4 && name.compare(name.size() - 4, 4, ".scr") == 0)
+                names.push_back(name);
+        }
+        closedir(dir);
+    }
+    std::sort(names.begin(), names.end());
+
+    // the snapshot and tape files built of each screen are written here
+    char files_dir[] = "/tmp/hqxcheck.XXXXXX";
+    if (!mkdtemp(files_dir)) {
+        perror(files_dir);
+        return -1;
+    }
+
+    std::map<std::string, uint64_t> sums;
+    std::vector<uint8_t> scr(ZX_SCREEN_SIZE), fb(SRC_W * SRC_H);
+    std::vector<std::vector<uint8_t> > screens;
+    for (const std::string &name : names) {
+        const unsigned index = &name - names.data();
+        FILE *f = fopen((std::string(dir_path) + "/" + name).c_str(), "rb");
+        if (!f)
+            continue;
+        bool ok = fread(scr.data(), 1, ZX_SCREEN_SIZE, f) == ZX_SCREEN_SIZE;
+        fclose(f);
+        if (!ok)
+            continue;
+        screens.push_back(scr);
+        c.failures += !check_screen_files(scr.data(), name, files_dir);
+        // the decoders at every level, then the reference decoding for the filters
+        for (const char *level : decode_levels) {
+            simd_select(level);
+            c.failures += !check_decode(scr.data(), name, level);
+        }
+        simd_select(best.c_str());
+        zx_decode(scr.data(), scr.data() + SRC_H * MAXX, fb.data());
+        std::vector<std::string> keys;
+        for (checker *k : checkers) {
+            keys.push_back(k->scale == 4 ? name : "hq" + std::to_string(k->scale) + "x:" + name);
+            check_screen(*k, scr.data(), fb.data(), index, keys.back());
+            sums[keys.back()] = k->sum;
+        }
+        if (update)
+            continue;
+        for (const std::string &key : keys) {
+            if (!golden.count(key)) {
+                printf("%s: no golden checksum in %s\n", key.c_str(), golden_path.c_str());
+                ++c.failures;
+            } else if (golden[key] != sums[key]) {
+                printf("%s: reference checksum %016llx, golden %016llx\n", key.c_str(),
+                       (unsigned long long)sums[key], (unsigned long long)golden[key]);
+                ++c.failures;
+            }
+        }
+    }
+    rmdir(files_dir);
+    c.failures += !check_tile_stream(screens);
+    if (windows)
+        for (checker *k : checkers)
+            exhaustive(*k);
+
+    if (update) {
+        FILE *f = fopen(golden_path.c_str(), "w");
+        if (!f) {
+            perror(golden_path.c_str());
+            return -1;
+        }
+        for (const auto &s : sums)
+            fprintf(f, "%s %016llx\n", s.first.c_str(), (unsigned long long)s.second);
+        fclose(f);
+        printf("%u golden checksums written to %s\n", unsigned(sums.size()), golden_path.c_str());
+    }
+    printf("tile cache: %llu hits, %llu misses\n", (unsigned long long)cache.hits, (unsigned long long)cache.misses);
+    unsigned kernels = decode_levels.size(), failures = 0;
+    if (names.empty()) {
+        printf("%s: no screens\n", dir_path);
+        ++failures;
+    }
+    for (checker *k : checkers) {
+        kernels += k->kernels();
+        failures += k->failures;
+    }
+    printf("%u screens, %u kernels: %s\n", unsigned(names.size()), kernels, failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,184 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "hqx.h"
+#include "hud.h"
+#include "perf.h"
+
+namespace {
+
+/* 5x7 glyphs, row by row from the top, bit 4 is the leftmost pixel */
+struct glyph {
+    char c;
+    uint8_t rows[7];
+};
+
+const glyph font[] = {
+    {' ', {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}},
+    {'%', {0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03}},
+    {'(', {0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02}},
+    {')', {0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08}},
+    {'+', {0x00, 0x04, 0x04, 0x1f, 0x04, 0x04, 0x00}},
+    {',', {0x00, 0x00, 0x00, 0x00, 0x0c, 0x04, 0x08}},
+    {'-', {0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00}},
+    {'.', {0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c}},
+    {'/', {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00}},
+    {'0', {0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e}},
+    {'1', {0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e}},
+    {'2', {0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f}},
+    {'3', {0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e}},
+    {'4', {0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02}},
+    {'5', {0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e}},
+    {'6', {0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e}},
+    {'7', {0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08}},
+    {'8', {0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e}},
+    {'9', {0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c}},
+    {':', {0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00}},
+    {'=', {0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00}},
+    {'A', {0x0e, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11}},
+    {'B', {0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e}},
+    {'C', {0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e}},
+    {'D', {0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c}},
+    {'E', {0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f}},
+    {'F', {0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10}},
+    {'G', {0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f}},
+    {'H', {0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11}},
+    {'I', {0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e}},
+    {'J', {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c}},
+    {'K', {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11}},
+    {'L', {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f}},
+    {'M', {0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11}},
+    {'N', {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11}},
+    {'O', {0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e}},
+    {'P', {0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10}},
+    {'Q', {0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d}},
+    {'R', {0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11}},
+    {'S', {0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e}},
+    {'T', {0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}},
+    {'U', {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e}},
+    {'V', {0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04}},
+    {'W', {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a}},
+    {'X', {0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11}},
+    {'Y', {0x11, 0x11, 0x0a, 0x04, 0x04, 0x04, 0x04}},
+    {'Z', {0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f}},
+    {'_', {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f}},
+};
+
+const unsigned ZOOM = 2;                   // font pixels are ZOOM x ZOOM
+const unsigned CHAR_W = 6 * ZOOM, LINE_H = 9 * ZOOM;
+const unsigned COLUMNS = 42, LINES = 14;
+const unsigned MARGIN = 4 * ZOOM;
+const unsigned GRAPH_H = 32 * ZOOM;
+
+const uint32_t BACKGROUND = 0xc0000000u;
+const uint32_t WHITE = 0xffffffffu, GREY = 0xffa0a0a0u, YELLOW = 0xffffff40u, GREEN = 0xff40e040u, RED = 0xffff4040u;
+
+const glyph *find(char c)
+{
+    c = toupper(c);
+    for (const glyph &g : font)
+        if (g.c == c)
+            return &g;
+    return NULL;
+}
+
+double ms(uint64_t ns)
+{
+    return ns / 1e6;
+}
+
+}
+
+perf_hud::perf_hud(unsigned s)
+    : width(COLUMNS * CHAR_W + 2 * MARGIN), height(LINES * LINE_H + GRAPH_H + 3 * MARGIN), scale(s)
+{
+    pixels.resize(width * height);
+}
+
+void perf_hud::fill(unsigned x, unsigned y, unsigned w, unsigned h, uint32_t colour)
+{
+    for (unsigned j = y; j < y + h && j < height; ++j)
+        std::fill(&pixels[j * width + x], &pixels[j * width + std::min(x + w, width)], colour);
+}
+
+void perf_hud::text(unsigned x, unsigned y, const char *s, uint32_t colour)
+{
+    for (; *s && x + CHAR_W <= width; ++s, x += CHAR_W) {
+        const glyph *g = find(*s);
+        if (!g)
+            continue;
+        for (unsigned r = 0; r < 7; ++r)
+            for (unsigned c = 0; c < 5; ++c)
+                if (g->rows[r] >> (4 - c) & 1)
+                    fill(x + c * ZOOM, y + r * ZOOM, ZOOM, ZOOM, colour);
+    }
+}
+
+void perf_hud::update()
+{
+    std::fill(pixels.begin(), pixels.end(), BACKGROUND);
+    char line[128]; // clipped to COLUMNS by text()
+    unsigned y = MARGIN;
+    snprintf(line, sizeof(line), "%-9s %7s %7s %7s", "MS", "LAST 64", "P95", "MAX");
+    text(MARGIN, y, line, GREY);
+    y += LINE_H;
+    for (unsigned s = 0; s < PERF_STAGES; ++s) {
+        const perf_histogram &h = perf_stage_stats(perf_stage(s));
+        if (!h.frames)
+            continue;
+        // the mean of the last frames, the percentile and maximum of all
+        const unsigned n = std::min<uint64_t>(h.frames, perf_histogram::RECENT);
+        uint64_t recent = 0;
+        for (unsigned i = 0; i < n; ++i)
+            recent += h.recent[i];
+        snprintf(line, sizeof(line), "%-9s %7.2f %7.2f %7.2f", perf_stage_names[s], ms(recent) / n,
+                 ms(h.percentile(0.95)), ms(h.max_ns));
+        text(MARGIN, y, line, s == PERF_FRAME ? YELLOW : WHITE);
+        y += LINE_H;
+    }
+    const uint64_t frames = std::max<uint64_t>(perf_frames(), 1);
+    const uint64_t pixels_filtered = perf_total(PERF_HQX_PIXELS);
+    snprintf(line, sizeof(line), "HQX %llu PX/FRAME, SOLID %.1f%%", (unsigned long long)(pixels_filtered / frames),
+             pixels_filtered ? 100.0 * perf_total(PERF_HQX_SOLID) / pixels_filtered : 0.0);
+    text(MARGIN, y, line, WHITE);
+    y += LINE_H;
+    snprintf(line, sizeof(line), "UPLOAD %llu PX/FRAME", (unsigned long long)(perf_total(PERF_UPLOAD_PIXELS) / frames));
+    text(MARGIN, y, line, WHITE);
+    y += LINE_H;
+
+    // the most taken rule branches, share of all rule outputs
+    const std::vector<hqx_rule_branch> rules = hqx_rule_branches(scale);
+    uint64_t outputs = 0;
+    for (const hqx_rule_branch &r : rules)
+        outputs += r.count;
+    snprintf(line, sizeof(line), "%-13s %-8s %-5s %7s", "RULE", "WEIGHTS", "PIXELS", "SHARE");
+    text(MARGIN, y, line, GREY);
+    y += LINE_H;
+    for (size_t i = 0; i < rules.size() && i < 4; ++i) {
+        const hqx_rule_branch &r = rules[i];
+        const char *name = strstr(r.rule, "rule_");
+        snprintf(line, sizeof(line), "%-13s %2u/%2u/%2u %u %u %u %6.1f%%", name ? name + 5 : r.rule, r.weights[0],
+                 r.weights[1], r.weights[2], r.pixels[0], r.pixels[1], r.pixels[2], 100.0 * r.count / outputs);
+        text(MARGIN, y, line, WHITE);
+        y += LINE_H;
+    }
+    if (rules.empty()) {
+        text(MARGIN, y, "NOT COUNTED", GREY);
+        y += LINE_H;
+    }
+
+    // frame times, oldest on the left, the line is 20 ms (50 Hz)
+    const perf_histogram &f = perf_stage_stats(PERF_FRAME);
+    const unsigned top = height - MARGIN - GRAPH_H, bar = (width - 2 * MARGIN) / perf_histogram::RECENT;
+    const uint64_t limit = 20000000;
+    const unsigned n = std::min<uint64_t>(f.frames, perf_histogram::RECENT);
+    for (unsigned i = 0; i < n; ++i) {
+        const uint64_t ns = f.recent[(f.frames - n + i) % perf_histogram::RECENT];
+        const unsigned h = std::max<uint64_t>(std::min<uint64_t>(ns * GRAPH_H / (2 * limit), GRAPH_H), 1);
+        fill(MARGIN + i * bar, top + GRAPH_H - h, bar - 1, h, ns > limit ? RED : GREEN);
+    }
+    fill(MARGIN, top + GRAPH_H / 2, width - 2 * MARGIN, 1, GREY);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+/* The viewer's statistics overlay (the h key): the stage times and counters
+ * of perf.h and the most taken hqx rule branches as text, and a graph of the
+ * last frame times. It is drawn by the CPU into ARGB pixels with a built-in
+ * 5x7 font, for a texture blended over the screen. */
+class perf_hud {
+public:
+    /* rule branches are those of hqx scale factor scale */
+    explicit perf_hud(unsigned scale);
+
+    /* redraws the overlay from the current statistics */
+    void update();
+
+    std::vector<uint32_t> pixels; // ARGB8888 with alpha, width pixels per row
+    unsigned width, height;
+
+private:
+    void fill(unsigned x, unsigned y, unsigned w, unsigned h, uint32_t colour);
+    void text(unsigned x, unsigned y, const char *s, uint32_t colour);
+
+    unsigned scale;
+};
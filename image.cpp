@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include <zlib.h>
+
+#include "image.h"
+
+static void put_rgb(uint8_t *out, const uint32_t *argb, unsigned width)
+{
+    for (unsigned x = 0; x < width; ++x) {
+        *out++ = argb[x] >> 16;
+        *out++ = argb[x] >> 8;
+        *out++ = argb[x];
+    }
+}
+
+bool write_ppm(const char *path, const uint32_t *argb, unsigned width, unsigned height)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+    std::vector<uint8_t> data(width * height * 3);
+    for (unsigned y = 0; y < height; ++y)
+        put_rgb(&data[y * width * 3], argb + y * width, width);
+    fprintf(f, "P6\n%u %u\n255\n", width, height);
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    return fclose(f) == 0 && ok;
+}
+
+static void put_be32(uint8_t *out, uint32_t v)
+{
+    out[0] = v >> 24;
+    out[1] = v >> 16;
+    out[2] = v >> 8;
+    out[3] = v;
+}
+
+static bool put_chunk(FILE *f, const char *type, const uint8_t *data, uint32_t len)
+{
+    uint8_t head[8], tail[4];
+    put_be32(head, len);
+    memcpy(head + 4, type, 4);
+    uLong crc = crc32(0, head + 4, 4);
+    if (len)
+        crc = crc32(crc, data, len);
+    put_be32(tail, crc);
+    return fwrite(head, 1, 8, f) == 8 && fwrite(data, 1, len, f) == len && fwrite(tail, 1, 4, f) == 4;
+}
+
+bool write_png(const char *path, const uint32_t *argb, unsigned width, unsigned height)
+{
+    // every row is prefixed by filter type 0, the flat areas deflate well as is
+    const size_t row = width * 3 + 1;
+    std::vector<uint8_t> raw(row * height);
+    for (unsigned y = 0; y < height; ++y) {
+        raw[y * row] = 0;
+        put_rgb(&raw[y * row + 1], argb + y * width, width);
+    }
+    uLongf len = compressBound(raw.size());
+    std::vector<uint8_t> z(len);
+    if (compress2(z.data(), &len, raw.data(), raw.size(), Z_BEST_SPEED) != Z_OK)
+        return false;
+
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    uint8_t ihdr[13];
+    put_be32(ihdr, width);
+    put_be32(ihdr + 4, height);
+    ihdr[8] = 8;   // bit depth
+    ihdr[9] = 2;   // truecolour
+    ihdr[10] = 0;  // deflate
+    ihdr[11] = 0;  // adaptive filtering
+    ihdr[12] = 0;  // no interlace
+
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+    bool ok = fwrite(signature, 1, 8, f) == 8 &&
+            put_chunk(f, "IHDR", ihdr, sizeof(ihdr)) &&
+            put_chunk(f, "IDAT", z.data(), len) &&
+            put_chunk(f, "IEND", NULL, 0);
+    return fclose(f) == 0 && ok;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdint.h>
+
+/* write an ARGB8888 image as 24 bit RGB, return false on I/O errors */
+bool write_ppm(const char *path, const uint32_t *argb, unsigned width, unsigned height);
+bool write_png(const char *path, const uint32_t *argb, unsigned width, unsigned height);
@@ -1,186 +1,706 @@
 #include <SDL2/SDL.h>
 
+#include <ctype.h>
 #include <stdint.h>
-#include <sys/types.h>
-#include <sys/stat.h>
+#include <stdlib.h>
 #include <unistd.h>
-#include <fcntl.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
 
 #include "colors.h"
+#include "frame_ring.h"
+#include "hqx.h"
+#include "hud.h"
+#include "perf.h"
+#include "pipeline.h"
+#include "render_thread.h"
+#include "resample.h"
+#include "snapshot.h"
+#include "thread_pool.h"
+#include "tile_cache.h"
+#include "zxscreen.h"
 
-const unsigned MAXX = 32;
-const unsigned MAXY = 24;
+/* the screen shown: loaded from a .scr file or the newest frame an emulator
+ * published in the shared memory ring */
+static zx_frame file_frame;
+static const zx_frame *vram = &file_frame;
+static frame_ring *ring;
 
-namespace vram {
-  uint8_t pix[MAXY*8][MAXX]; //6144
-  uint8_t attr[MAXY][MAXX]; //768
+/* copy of the VRAM currently on screen and the cells that differ from it */
+namespace shown {
+  uint8_t pix[MAXY*8][MAXX];
+  uint8_t attr[MAXY][MAXX];
+  bool dirty[MAXY][MAXX];
+  bool all = true;
+  unsigned flash; // phase on screen
+  uint8_t border[ZX_BORDER_H];
+  uint64_t generation; // -p: of the settings the frame on screen was drawn with
+  bool flashing;       // -p: the frame on screen has flashing cells
 }
 
-uint8_t sinc_fb[192*256];
-YUV_pixel sinc4_fb[768*1024];
+/* decoded screen per flash phase, and upscaled per algorithm (plain pixel
+ * multiply, hqx) and phase; phase 1 only differs around flashing cells and is
+ * only kept up to date there */
+uint8_t sinc_fb[2][192*256];
+uint32_t sinc4_fb[2][2][768*1024]; // ARGB8888, as uploaded to the textures
+
+/* -x: the hqx factor, sinc4_fb rows are fb_pitch pixels apart */
+static unsigned scale = 4;
+static unsigned fb_pitch = MAXX*8*4;
+static const zx_scaler *scaler;
 
+/* c: the algorithm shown, both are always rendered, so switching only
+ * changes the texture presented */
 static bool compare = false;
+/* w: both side by side, the one c selects left of the divider at window
+ * column wipe_x */
+static bool wipe = false;
+static int wipe_x;
+static int window_w, window_h;
+static bool streaming = false;
+/* -b: the 320x240 screen with the border, rendered like -s */
+static bool bordered = false;
+static uint8_t border_colour;
+/* -g: the picture resampled to fit a window of any size, rendered like -s */
+static resampler *fit;
+static thread_pool *pool;
+static tile_cache *cache; // hqx cells by content, NULL unless -t
+/* -p: frames are drawn by a render thread, the main thread only presents */
+static render_thread *pipelined;
+static render_settings requested;
+static Uint32 frame_event;
+static std::atomic<bool> frame_posted(false);
+
+/* h: the statistics overlay, redrawn at most every HUD_PERIOD ms */
+static perf_hud *hud;
+static bool show_hud = false;
+static SDL_Texture *hud_texture;
+static Uint32 hud_updated;
+static const Uint32 HUD_PERIOD = 250;
+/* -S: where the statistics go on exit */
+static const char *stats_path;
+
+/* timestamp (SDL ticks) of the oldest input not yet on screen, 0 if none */
+static Uint32 input_pending;
+/* set while VRAM can change on its own, frames are then paced by vsync */
+static bool animating = false;
+
+/* input at time timestamp changed what is shown, its latency is measured
+ * up to the next present */
+void input_shown(Uint32 timestamp)
+{
+  if (!input_pending)
+    input_pending = timestamp;
+}
 
-int handleInput()
+/* puts the divider at window column x, returns 1 if it moved */
+int move_wipe(int x)
+{
+  x = std::max(0, std::min(x, window_w));
+  if (x == wipe_x)
+    return 0;
+  wipe_x = x;
+  return 1;
+}
+
+/* waits up to timeout ms (-1 forever) for events and handles all queued ones,
+ * returns <0 to quit, 1 if the screen has to be redrawn */
+int handleInput(int timeout)
 {
   SDL_Event event;
-  while (SDL_PollEvent(&event)) {
+  int redraw = 0;
+  if (!SDL_WaitEventTimeout(&event, timeout))
+    return 0;
+  do {
     switch (event.type) {
     case SDL_QUIT:
       return -1;
+    case SDL_WINDOWEVENT:
+      if (event.window.event == SDL_WINDOWEVENT_EXPOSED)
+        redraw = 1;
+      break;
+    case SDL_MOUSEBUTTONDOWN:
+      // the divider jumps to a click and follows drags
+      if (wipe && event.button.button == SDL_BUTTON_LEFT && move_wipe(event.button.x)) {
+        input_shown(event.button.timestamp);
+        redraw = 1;
+      }
+      break;
+    case SDL_MOUSEMOTION:
+      if (wipe && (event.motion.state & SDL_BUTTON_LMASK) && move_wipe(event.motion.x)) {
+        input_shown(event.motion.timestamp);
+        redraw = 1;
+      }
+      break;
     case SDL_KEYDOWN:
       if (event.key.keysym.sym == SDLK_c) {
         compare = !compare;
-        return 0;
+        input_shown(event.key.timestamp);
+        redraw = 1;
+      }
+      if (event.key.keysym.sym == SDLK_w) {
+        wipe = !wipe;
+        input_shown(event.key.timestamp);
+        redraw = 1;
+      }
+      // the arrows move the divider a character cell, of the picture inside
+      // the black bars with -g
+      if (wipe && (event.key.keysym.sym == SDLK_LEFT || event.key.keysym.sym == SDLK_RIGHT)) {
+        const int cell = (fit ? int(fit->w) : window_w) / (bordered ? ZX_BORDER_W / 8 : MAXX);
+        if (move_wipe(wipe_x + (event.key.keysym.sym == SDLK_LEFT ? -cell : cell))) {
+          input_shown(event.key.timestamp);
+          redraw = 1;
+        }
+      }
+      if (event.key.keysym.sym == SDLK_h) {
+        show_hud = !show_hud;
+        // the rule branches are only counted while someone looks at them
+        perf_count_rules = show_hud || stats_path;
+        hud_updated = 0;
+        redraw = 1;
       }
       if (event.key.keysym.sym == SDLK_ESCAPE)
         return -2;
       break;
     default:
+      if (event.type == frame_event)
+        redraw = 1;
       break;
     }
-  }
-  return 0;
+  } while (SDL_PollEvent(&event));
+  return redraw;
 }
 
+/* collects samples in ms, summarized on exit */
+struct timing {
+  const char *name;
+  std::vector<double> ms;
+
+  explicit timing(const char *n) : name(n) {}
+  void report() {
+    if (ms.empty())
+      return;
+    std::sort(ms.begin(), ms.end());
+    double sum = 0;
+    for (double v : ms)
+      sum += v;
+    fprintf(stderr, "%s: %u samples, mean %.2f ms, median %.2f ms, p95 %.2f ms, max %.2f ms\n", name,
+            unsigned(ms.size()), sum / ms.size(), ms[ms.size() / 2], ms[ms.size() * 95 / 100], ms.back());
+  }
+};
+
+static timing frame_time("frame time");
+static timing input_latency("input to photon");
+
 SDL_Renderer *renderer;
+SDL_Texture *textures[2]; // plain pixel multiply and hqx
+static unsigned texture_pixels;
 
 void initVideo()
 {
+  const int w = fit ? fit->dst_w : (bordered ? ZX_BORDER_W : MAXX*8) * scale;
+  const int h = fit ? fit->dst_h : (bordered ? ZX_BORDER_H : MAXY*8) * scale;
+  char title[64];
+  snprintf(title, sizeof(title), "ZX Spectrum x%u - SDL", scale);
   SDL_Init(SDL_INIT_VIDEO);
-  SDL_Window *window = SDL_CreateWindow("ZX Spectrum x4 - SDL", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, MAXX*8*4, MAXY*8*4, 0);
-  renderer = SDL_CreateRenderer(window, -1, 0);
-}
-
-extern void hqx_filter(const uint8_t *src, YUV_pixel *dst, unsigned width, unsigned height);
-
-uint8_t get_sinclair_color(unsigned x, unsigned y) {
-    unsigned yb = y >> 3, xb = x >> 3, xbit = x & 0b111, ybit = y &0b111;
-    uint8_t attr = vram::attr[yb][xb];
-    uint8_t fg = 0b111 & attr;
-    uint8_t bg = 0b111 & (attr >> 3);
-    uint8_t bright = (attr >> 6) & 1;
-    uint8_t pix8 = vram::pix[(yb & 0b11000 | ybit) << 3 | (yb & 0b111)][xb];
-    return (bright << 3) | ((pix8 & (1 << (7 - xbit)))?fg:bg);
-    //return yuv_colors[ci];
-}
-
-void calc_area() {
-    uint32_t w[9];
-    for (unsigned y = 0; y < 192; ++y) {
-        unsigned yprev = (y > 0) ? y - 1 : y;
-        unsigned ynext = (y < 192 - 1)? y + 1:y;
-        for (unsigned x = 0; x < 256; ++x) {
-            unsigned xprev = (x > 0) ? x - 1 : x;
-            unsigned xnext = (x < 256 - 1) ? x + 1: x;
-            w[0] = get_sinclair_color(xprev, yprev);
-            w[1] = get_sinclair_color(x, yprev);
-            w[2] = get_sinclair_color(xnext, yprev);
-            w[3] = get_sinclair_color(xprev, y);
-            w[4] = get_sinclair_color(x, y);
-            w[5] = get_sinclair_color(xnext, y);
-            w[6] = get_sinclair_color(xprev, ynext);
-            w[7] = get_sinclair_color(x, ynext);
-            w[8] = get_sinclair_color(xnext, ynext);
+  SDL_Window *window = SDL_CreateWindow(title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, w, h, 0);
+  renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_PRESENTVSYNC);
+  // whole frame is written by the CPU once and uploaded with a single copy
+  for (unsigned hq = 0; hq < 2; ++hq)
+    textures[hq] = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, w, h);
+  texture_pixels = w * h;
+  window_w = w;
+  window_h = h;
+  wipe_x = w / 2;
+}
+
+/* compares VRAM against what is on screen cell by cell, returns the number
+ * of 8x8 cells to redraw */
+unsigned track_changes() {
+    perf_scope timed(PERF_TRACK);
+    unsigned n = 0;
+    for (unsigned yb = 0; yb < MAXY; ++yb) {
+        for (unsigned xb = 0; xb < MAXX; ++xb) {
+            bool d = shown::all || vram->attr[yb][xb] != shown::attr[yb][xb];
+            for (unsigned ybit = 0; ybit < 8 && !d; ++ybit) {
+                unsigned row = (yb & 0b11000 | ybit) << 3 | (yb & 0b111);
+                d = vram->pix[row][xb] != shown::pix[row][xb];
+            }
+            shown::dirty[yb][xb] = d;
+            n += d;
         }
     }
+    if (n) {
+        memcpy(shown::pix, vram->pix, sizeof(shown::pix));
+        memcpy(shown::attr, vram->attr, sizeof(shown::attr));
+    }
+    shown::all = false;
+    return n;
 }
-void drawScreen() {
-    bool use_hq4 = false;
-    if (compare)
-        use_hq4 = true;
-#if 1
-    for (unsigned y = 0; y < 192; ++y) {
-        for (unsigned x = 0; x < 256; ++x) {
-            if (use_hq4)
-                sinc_fb[y*256 + x] = get_sinclair_color(x, y);
-            else {
-                RGB_pixel rgb;
-                uint8_t ci = get_sinclair_color(x, y);
-                sinc2rgb(rgb, ci);
-                SDL_SetRenderDrawColor(renderer, rgb.r, rgb.g, rgb.b, 255);
-                int xo = x * 4;
-                int yo = y * 4;
-                for (unsigned i = 0; i < 4; ++i)
-                    for (unsigned j = 0; j < 4; ++j)
-                        SDL_RenderDrawPoint(renderer, xo + i, yo + j);
-            }
+
+/* plain scale x scale pixel multiply of source pixels [x0, x1) x [y0, y1) */
+void scaleNx(unsigned phase, unsigned x0, unsigned y0, unsigned x1, unsigned y1) {
+    for (unsigned y = y0; y < y1; ++y) {
+        for (unsigned x = x0; x < x1; ++x) {
+            RGB_pixel rgb;
+            sinc2rgb(rgb, sinc_fb[phase][y*256 + x]);
+            uint32_t argb = rgb2argb(rgb);
+            uint32_t *out = sinc4_fb[0][phase] + y * scale * fb_pitch + x * scale;
+            for (unsigned j = 0; j < scale; ++j, out += fb_pitch)
+                for (unsigned i = 0; i < scale; ++i)
+                    out[i] = argb;
         }
     }
-#else
-    for (unsigned y = 0; y < maxy; ++y) {
-        for (unsigned x = 0; x < maxx; ++x) {
-            uint8_t attr = vram.attr[y * maxx + x];
-            uint8_t fg = 0b111 & attr;
-            uint8_t bk = 0b111 & (attr >> 3);
-            uint8_t bright = 1 & (attr >> 6);
-            //attr >>= 1;
-            //uint8_t flash = 1 & attr;
-            int off0 = (y & 0b11000) << 8 | (y & 0b111) << 5 | x;
-            for (unsigned iy = 0; iy < 8; ++iy) {
-                uint8_t pix8 = vram.pix[off0 | iy << 8];
-                for (unsigned ix = 0; ix < 8; ++ix, pix8 <<= 1) {
-                    uint8_t pix = !!(0x80 & pix8);
-                    unsigned ci = (bright << 3)|(pix ? fg : bk);
-                    if (use_hq4) {
-                        int xo = (x * 8 + ix);
-                        int yo = (y * 8 + iy);
-                        vram.sinc_fb[yo * 256 + xo] = yuv_colors[ci];
-                    } else {
-                        SDL_SetRenderDrawColor(renderer, rgb_colors[ci] >> 16, rgb_colors[ci] >> 8, rgb_colors[ci], 255);
-                        int xo = (x * 8 + ix);
-                        int yo = (y * 8 + iy);
-                        uint8_t ci = get_sinclair_color(xo, yo);
-                        for (unsigned i = 0; i < 4; ++i)
-                            for (unsigned j = 0; j < 4; ++j)
-                                SDL_RenderDrawPoint(renderer, xo*4 + i, yo*4 + j);
-                    }
-                }
+}
+
+/* uploads the output of source pixels [x0, x1) x [y0, y1) to the texture of
+ * the algorithm */
+void updateTexture(bool use_hq4, unsigned phase, unsigned x0, unsigned y0, unsigned x1, unsigned y1) {
+    perf_scope timed(PERF_UPLOAD);
+    SDL_Rect rect = {int(x0 * scale), int(y0 * scale), int((x1 - x0) * scale), int((y1 - y0) * scale)};
+    SDL_UpdateTexture(textures[use_hq4], &rect, sinc4_fb[use_hq4][phase] + rect.y * fb_pitch + rect.x,
+                      fb_pitch * sizeof(uint32_t));
+    perf_count(PERF_UPLOAD_PIXELS, rect.w * rect.h);
+}
+
+/* flash phase of the Spectrum at the current time, 50 frames a second */
+unsigned flash_phase() {
+    return SDL_GetTicks() / (ZX_FLASH_FRAMES * 1000 / 50) & 1;
+}
+
+bool flashing(unsigned xb, unsigned yb) {
+    return shown::attr[yb][xb] & 0x80;
+}
+
+/* ms until the next flash phase change if a cell on screen flashes, else -1 */
+int flash_timeout() {
+    const unsigned period = ZX_FLASH_FRAMES * 1000 / 50;
+    if (pipelined)
+        return shown::flashing ? period - SDL_GetTicks() % period : -1;
+    for (unsigned yb = 0; yb < MAXY; ++yb)
+        for (unsigned xb = 0; xb < MAXX; ++xb)
+            if (flashing(xb, yb))
+                return period - SDL_GetTicks() % period;
+    return -1;
+}
+
+/* true if any cell up to r cells away from (xb, yb) is dirty */
+bool dirty_around(unsigned xb, unsigned yb, unsigned r = 1) {
+    for (unsigned y = yb > r ? yb - r : 0; y <= yb + r && y < MAXY; ++y)
+        for (unsigned x = xb > r ? xb - r : 0; x <= xb + r && x < MAXX; ++x)
+            if (shown::dirty[y][x])
+                return true;
+    return false;
+}
+
+/* source rect of the cells [xb, xe) in row yb, with hqx widened by the 1
+ * pixel halo they influence */
+void cell_rect(unsigned xb, unsigned xe, unsigned yb, bool halo, unsigned r[4]) {
+    r[0] = xb * 8, r[1] = yb * 8, r[2] = xe * 8, r[3] = yb * 8 + 8;
+    if (halo) {
+        r[0] = r[0] ? r[0] - 1 : 0;
+        r[1] = r[1] ? r[1] - 1 : 0;
+        r[2] = r[2] < 256 ? r[2] + 1 : 256;
+        r[3] = r[3] < 192 ? r[3] + 1 : 192;
+    }
+}
+
+/* decodes the cells changed since the previous frame in both flash phases */
+void decode_changes(unsigned changed) {
+    if (changed == MAXX * MAXY) {
+        for (unsigned phase = 0; phase < 2; ++phase)
+            zx_decode(&vram->pix[0][0], &vram->attr[0][0], sinc_fb[phase], phase);
+        return;
+    }
+    for (unsigned yb = 0; yb < MAXY; ++yb)
+        for (unsigned xb = 0; xb < MAXX; ++xb)
+            if (shown::dirty[yb][xb])
+                for (unsigned phase = 0; phase < 2; ++phase)
+                    zx_decode_cell(&vram->pix[0][0], &vram->attr[0][0], xb, yb, sinc_fb[phase], phase);
+}
+
+/* upscales the decoded cells changed since the previous frame in flash phase
+ * 0 with one algorithm; with hqx the 1 pixel halo around them is refiltered
+ * too as it sees the new neighbours */
+void redraw_changes(unsigned changed, bool use_hq4) {
+    if (changed == MAXX * MAXY) {
+        if (use_hq4 && cache)
+            cache->render(sinc_fb[0], 256, 192, sinc4_fb[1][0]);
+        else if (use_hq4)
+            scaler->filter_pool(*pool, sinc_fb[0], sinc4_fb[1][0], 256, 192);
+        else
+            scaleNx(0, 0, 0, 256, 192);
+        updateTexture(use_hq4, 0, 0, 0, 256, 192);
+        return;
+    }
+    if (use_hq4 && cache) {
+        // a changed cell is part of the key of its 8 neighbours, which are
+        // looked up again as well
+        for (unsigned yb = 0; yb < MAXY; ++yb) {
+            for (unsigned xb = 0; xb < MAXX; ++xb) {
+                if (!dirty_around(xb, yb))
+                    continue;
+                cache->render_cell(sinc_fb[0], 256, 192, xb, yb, sinc4_fb[1][0] + (yb * fb_pitch + xb) * 8 * scale,
+                                   fb_pitch);
+                updateTexture(true, 0, xb * 8, yb * 8, xb * 8 + 8, yb * 8 + 8);
             }
         }
+        return;
     }
-#endif
-    if (use_hq4) {
-        hqx_filter(sinc_fb, sinc4_fb, 256,192);
-        for (int y = 0; y < 768; ++y) {
-            for (int x = 0; x < 1024; ++x) {
-                RGB_pixel rgb;
-                yuv2rgb(rgb, sinc4_fb[y*1024+x]);
-                SDL_SetRenderDrawColor(renderer, rgb.r, rgb.g, rgb.b, 255);
-                SDL_RenderDrawPoint(renderer, x, y);
+    // runs of dirty cells in a character row are redrawn as one rectangle
+    for (unsigned yb = 0; yb < MAXY; ++yb) {
+        for (unsigned xb = 0; xb < MAXX; ++xb) {
+            if (!shown::dirty[yb][xb])
+                continue;
+            unsigned xe = xb;
+            while (xe < MAXX && shown::dirty[yb][xe])
+                ++xe;
+            unsigned r[4];
+            cell_rect(xb, xe, yb, use_hq4, r);
+            if (use_hq4)
+                scaler->filter_rect(sinc_fb[0], sinc4_fb[1][0], 256, 192, r[0], r[1], r[2], r[3]);
+            else
+                scaleNx(0, r[0], r[1], r[2], r[3]);
+            updateTexture(use_hq4, 0, r[0], r[1], r[2], r[3]);
+            xb = xe;
+        }
+    }
+}
+
+/* Both phases of the flashing cells are kept upscaled, so a phase change
+ * only uploads those cells and their halos from the other buffer. Phase 1
+ * is redrawn where a flashing cell or one of its neighbours changed. */
+void update_flash(unsigned changed, bool flip, bool use_hq4) {
+    const unsigned phase = shown::flash;
+    for (unsigned yb = 0; yb < MAXY; ++yb) {
+        for (unsigned xb = 0; xb < MAXX; ++xb) {
+            if (!flashing(xb, yb))
+                continue;
+            const bool stale = changed == MAXX * MAXY || (changed && dirty_around(xb, yb));
+            // the cached redraw uploads whole cells next to the changed ones,
+            // reaching into the halo of flashing cells 2 cells away
+            const bool covered = stale || (changed && use_hq4 && cache && dirty_around(xb, yb, 2));
+            unsigned r[4];
+            cell_rect(xb, xb + 1, yb, use_hq4, r);
+            if (stale) {
+                if (use_hq4 && cache) {
+                    for (unsigned y = yb ? yb - 1 : 0; y <= yb + 1 && y < MAXY; ++y)
+                        for (unsigned x = xb ? xb - 1 : 0; x <= xb + 1 && x < MAXX; ++x)
+                            cache->render_cell(sinc_fb[1], 256, 192, x, y,
+                                               sinc4_fb[1][1] + (y * fb_pitch + x) * 8 * scale, fb_pitch);
+                } else if (use_hq4) {
+                    scaler->filter_rect(sinc_fb[1], sinc4_fb[1][1], 256, 192, r[0], r[1], r[2], r[3]);
+                } else {
+                    scaleNx(1, r[0], r[1], r[2], r[3]);
+                }
             }
+            // redraw_changes() left phase 0 on screen around the changes
+            if (flip || (covered && phase))
+                updateTexture(use_hq4, phase, r[0], r[1], r[2], r[3]);
         }
     }
 }
 
-void draw()
+/* -s, -b and -g: the whole frame goes from VRAM into the texture of an
+ * algorithm a line at a time, there is no other phase to swap in; lines is
+ * the border colour of every line */
+bool stream_frame(bool use_hq4, const uint8_t *lines, unsigned phase) {
+    void *locked;
+    int pitch;
+    if (SDL_LockTexture(textures[use_hq4], NULL, &locked, &pitch) != 0)
+        return false;
+    uint32_t *pixels = static_cast<uint32_t *>(locked);
+    if (fit) {
+        scaler->fit(*pool, &vram->pix[0][0], &vram->attr[0][0], bordered ? lines : NULL, use_hq4, *fit, pixels,
+                    pitch / sizeof(uint32_t), phase);
+    } else if (bordered) {
+        if (use_hq4)
+            scaler->border_hqx_pool(*pool, &vram->pix[0][0], &vram->attr[0][0], lines, pixels,
+                                    pitch / sizeof(uint32_t), phase);
+        else
+            scaler->border_nx(&vram->pix[0][0], &vram->attr[0][0], lines, pixels, pitch / sizeof(uint32_t),
+                              0, ZX_BORDER_H, phase);
+    } else if (use_hq4)
+        scaler->hqx_pool(*pool, &vram->pix[0][0], &vram->attr[0][0], pixels, pitch / sizeof(uint32_t), phase);
+    else
+        scaler->nx(&vram->pix[0][0], &vram->attr[0][0], pixels, pitch / sizeof(uint32_t), 0, 192, phase);
+    SDL_UnlockTexture(textures[use_hq4]);
+    perf_count(PERF_UPLOAD_PIXELS, texture_pixels);
+    return true;
+}
+
+/* redraws what changed since the previous frame, including flashing cells
+ * whose phase changed. Returns false if nothing changed. */
+bool drawScreen() {
+    const unsigned changed = track_changes();
+    const unsigned phase = flash_phase();
+    const bool flip = phase != shown::flash;
+    shown::flash = phase;
+    bool any_flashing = false;
+    for (unsigned yb = 0; yb < MAXY && !any_flashing; ++yb)
+        for (unsigned xb = 0; xb < MAXX && !any_flashing; ++xb)
+            any_flashing = flashing(xb, yb);
+    // live frames carry their border colour per line, files take the one
+    // given to -b
+    uint8_t border[ZX_BORDER_H];
+    for (unsigned y = 0; y < ZX_BORDER_H; ++y)
+        border[y] = ring ? vram->border[y] & 0b111 : border_colour;
+    const bool border_changed = bordered && memcmp(border, shown::border, sizeof(border)) != 0;
+    memcpy(shown::border, border, sizeof(border));
+    if (!changed && !border_changed && !(flip && any_flashing))
+        return false;
+    perf_scope timed(PERF_RENDER);
+    // both algorithms are kept on their textures, whichever is shown
+    if (streaming || bordered || fit) {
+        for (unsigned hq = 0; hq < 2; ++hq)
+            if (!stream_frame(hq, border, phase))
+                return false;
+        return true;
+    }
+    if (changed) {
+        decode_changes(changed);
+        for (unsigned hq = 0; hq < 2; ++hq)
+            redraw_changes(changed, hq);
+    }
+    if (any_flashing)
+        for (unsigned hq = 0; hq < 2; ++hq)
+            update_flash(changed, flip, hq);
+    return true;
+}
+
+/* what the render thread is to draw now */
+render_settings current_settings() {
+    render_settings s = render_settings();
+    s.bordered = bordered;
+    s.border = border_colour;
+    s.fit = fit;
+    // the phase only matters, and only causes redraws, with flashing cells
+    s.flash = shown::flashing ? flash_phase() : requested.flash;
+    s.generation = requested.generation;
+    return s;
+}
+
+/* called on the render thread, at most one frame event is queued at a time */
+void frame_ready() {
+    if (frame_posted.exchange(true))
+        return;
+    SDL_Event event;
+    memset(&event, 0, sizeof(event));
+    event.type = frame_event;
+    SDL_PushEvent(&event);
+}
+
+/* -p: requests a new frame if the settings changed and uploads the newest
+ * frame the render thread finished, returns false if there was none */
+bool upload_rendered() {
+    render_settings s = current_settings();
+    if (s.border != requested.border || s.flash != requested.flash) {
+        ++s.generation;
+        requested = s;
+        pipelined->request(s);
+    }
+    frame_posted.store(false);
+    const rendered_frame *f = pipelined->frames.take();
+    if (!f)
+        return false;
+    perf_scope timed(PERF_UPLOAD);
+    for (unsigned hq = 0; hq < 2; ++hq)
+        SDL_UpdateTexture(textures[hq], NULL, f->pixels[hq].data(), f->width * sizeof(uint32_t));
+    perf_count(PERF_UPLOAD_PIXELS, 2 * f->width * f->height);
+    shown::generation = f->generation;
+    shown::flashing = f->flashing;
+    return true;
+}
+
+/* the algorithm c selects left of the divider, the other one right of it */
+void draw_wipe()
 {
-  SDL_SetRenderDrawColor(renderer, 100, 100, 100, 255);
-  SDL_RenderClear(renderer);
-  drawScreen();
-  SDL_RenderPresent(renderer);
+  const SDL_Rect left = {0, 0, wipe_x, window_h}, right = {wipe_x, 0, window_w - wipe_x, window_h};
+  SDL_RenderCopy(renderer, textures[compare], &left, &left);
+  SDL_RenderCopy(renderer, textures[!compare], &right, &right);
+  const SDL_Rect divider = {wipe_x - 1, 0, 2, window_h};
+  SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+  SDL_RenderFillRect(renderer, &divider);
+}
+
+/* the statistics overlay in the top left corner, created on first use */
+void draw_hud()
+{
+  if (!hud) {
+    hud = new perf_hud(scale);
+    hud_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, hud->width,
+                                    hud->height);
+    SDL_SetTextureBlendMode(hud_texture, SDL_BLENDMODE_BLEND);
+  }
+  if (!hud_updated || SDL_GetTicks() - hud_updated >= HUD_PERIOD) {
+    hud->update();
+    SDL_UpdateTexture(hud_texture, NULL, hud->pixels.data(), hud->width * sizeof(uint32_t));
+    hud_updated = SDL_GetTicks();
+  }
+  SDL_Rect r = {8, 8, int(hud->width), int(hud->height)};
+  SDL_RenderCopy(renderer, hud_texture, NULL, &r);
+}
+
+/* redraws what changed and presents, returns false if nothing changed and
+ * no redraw was forced */
+bool present(bool force)
+{
+  Uint64 start = SDL_GetPerformanceCounter();
+  if (pipelined) {
+    if (!upload_rendered() && !force)
+      return false;
+  } else {
+    // frames published since the last one are skipped
+    if (ring)
+      if (const zx_frame *frame = ring->take())
+        vram = frame;
+    if (!drawScreen() && !force)
+      return false;
+  }
+  {
+    perf_scope timed(PERF_PRESENT);
+    if (wipe)
+      draw_wipe();
+    else
+      SDL_RenderCopy(renderer, textures[compare], NULL, NULL);
+    if (show_hud)
+      draw_hud();
+    SDL_RenderPresent(renderer);
+  }
+  frame_time.ms.push_back((SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency());
+  // with -p the input shows once a frame drawn after it is presented
+  if (input_pending && (!pipelined || shown::generation == requested.generation)) {
+    input_latency.ms.push_back(SDL_GetTicks() - input_pending);
+    input_pending = 0;
+  }
+  return true;
+}
+
+/* present() as a frame of the statistics, which is all the work since the
+ * previous frame presented, checks that found nothing to draw included */
+bool draw(bool force)
+{
+  bool drawn;
+  {
+    perf_scope timed(PERF_FRAME);
+    drawn = present(force);
+  }
+  if (drawn)
+    perf_frame_end();
+  return drawn;
 }
 
 int main(int argc, char *argv[])
 {
   //top = new Vmy_computer;
-  if (argc < 2)
-    exit(-1);
-  int fd = open(argv[1], O_RDONLY);
-  if (fd == -1)
-    exit(fd);
-  int len = sizeof(vram::pix) + sizeof(vram::attr);
-  int x = read(fd, &vram::pix, len);
-  if (x != len)
+  unsigned threads = 0;
+  bool use_cache = false, pipeline = false;
+  unsigned fit_w = 0, fit_h = 0;
+  int opt;
+  const char *ring_name = NULL;
+  while ((opt = getopt(argc, argv, "j:stpr:b:x:g:S:")) != -1) {
+    switch (opt) {
+    case 'j': {
+      // 0 is one thread per core, a sign would wrap around
+      char *end;
+      const unsigned long n = strtoul(optarg, &end, 10);
+      if (!isdigit((unsigned char)*optarg) || *end || n > 1024)
+        exit(-1);
+      threads = n;
+      break;
+    }
+    case 's':
+      streaming = true;
+      break;
+    case 't':
+      use_cache = true;
+      break;
+    case 'p':
+      pipeline = true;
+      break;
+    case 'r':
+      ring_name = optarg;
+      break;
+    case 'b':
+      bordered = true;
+      border_colour = atoi(optarg) & 0b111;
+      break;
+    case 'x':
+      scale = atoi(optarg);
+      break;
+    case 'g':
+      if (sscanf(optarg, "%ux%u", &fit_w, &fit_h) != 2 || !fit_w || !fit_h)
+        exit(-1);
+      break;
+    case 'S':
+      stats_path = optarg;
+      perf_count_rules = true;
+      break;
+    default:
+      exit(-1);
+    }
+  }
+  scaler = zx_scaler_for(scale);
+  if (!scaler)
     exit(-1);
-  close(fd);
+  fb_pitch = MAXX*8 * scale;
+  if (fit_w)
+    fit = new resampler((bordered ? ZX_BORDER_W : MAXX*8) * scale, (bordered ? ZX_BORDER_H : MAXY*8) * scale,
+                        fit_w, fit_h);
+  if (use_cache)
+    cache = new tile_cache(2048, scale);
+  if (ring_name) {
+    // live frames from an emulator, the screen stays black until the first
+    ring = frame_ring::open(ring_name);
+    if (!ring) {
+      perror(ring_name);
+      exit(-1);
+    }
+    animating = true;
+  } else {
+    if (optind >= argc)
+      exit(-1);
+    // a snapshot shows the border it was taken with instead of the -b colour
+    if (!zx_load_screen(argv[optind], &file_frame.pix[0][0], &border_colour)) {
+      perror(argv[optind]);
+      exit(-1);
+    }
+  }
   color_init();
+  hqx_init();
+  thread_pool workers(threads);
+  pool = &workers;
   initVideo();
-#if 1
+  if (pipeline) {
+    frame_event = SDL_RegisterEvents(1);
+    requested = current_settings();
+    pipelined = new render_thread(*scaler, workers, ring, &file_frame, requested, frame_ready);
+  }
+  // nothing is recomputed unless input, VRAM or the flash phase changed: a
+  // static screen sleeps in SDL_WaitEventTimeout, a live one checks once per
+  // frame
+  int status = 1;
   do {
-    draw();
-    SDL_Delay(200);
-  } while (handleInput() >= 0);
-#endif
+    draw(status > 0);
+    // the render thread wakes us with an event for every frame
+    status = handleInput(animating && !pipelined ? 1000 / 50 : flash_timeout());
+  } while (status >= 0);
+  if (pipelined) {
+    const uint64_t dropped = pipelined->frames.dropped;
+    delete pipelined;
+    fprintf(stderr, "rendered frames dropped: %llu\n", (unsigned long long)dropped);
+  }
+  frame_time.report();
+  input_latency.report();
+  if (ring)
+    fprintf(stderr, "frames dropped: %llu\n", (unsigned long long)ring->dropped);
+  if (cache)
+    fprintf(stderr, "tile cache: %llu hits, %llu misses\n", (unsigned long long)cache->hits, (unsigned long long)cache->misses);
+  if (stats_path && !perf_dump(stats_path, scale))
+    perror(stats_path);
   return 0;
 }
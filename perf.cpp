@@ -0,0 +1,197 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "hqx.h"
+#include "perf.h"
+
+const char *const perf_stage_names[PERF_STAGES] = {"frame", "track", "render", "hqx_cpu", "upload", "present"};
+const char *const perf_counter_names[PERF_COUNTERS] = {"hqx_pixels", "hqx_solid", "upload_pixels"};
+
+std::atomic<bool> perf_count_rules(false);
+
+namespace {
+
+/* the counters of every thread that ever counted, kept when it ends */
+std::mutex registry_lock;
+std::vector<perf_thread_counters *> registry;
+
+/* stage totals at the end of the last frame */
+uint64_t last_ns[PERF_STAGES], last_calls[PERF_STAGES];
+perf_histogram histograms[PERF_STAGES];
+uint64_t frames_ended;
+
+unsigned bucket_of(uint64_t ns)
+{
+    if (ns < 1000)
+        return 0;
+    const unsigned b = 1 + unsigned(4 * log2(ns / 1000.0));
+    return std::min(b, perf_histogram::BUCKETS - 1);
+}
+
+double ms(uint64_t ns)
+{
+    return ns / 1e6;
+}
+
+}
+
+perf_thread_counters &perf_local()
+{
+    static thread_local perf_thread_counters *local;
+    if (!local) {
+        // value initialized, all counters 0
+        local = new perf_thread_counters();
+        std::lock_guard<std::mutex> guard(registry_lock);
+        registry.push_back(local);
+    }
+    return *local;
+}
+
+void perf_histogram::add(uint64_t ns)
+{
+    if (frames == 0 || ns < min_ns)
+        min_ns = ns;
+    max_ns = std::max(max_ns, ns);
+    recent[frames % RECENT] = ns;
+    ++bucket[bucket_of(ns)];
+    ++frames;
+    total_ns += ns;
+}
+
+uint64_t perf_histogram::upper(unsigned b)
+{
+    return uint64_t(1000 * pow(2.0, b / 4.0));
+}
+
+uint64_t perf_histogram::percentile(double p) const
+{
+    const uint64_t rank = uint64_t(ceil(p * frames));
+    uint64_t seen = 0;
+    for (unsigned b = 0; b < BUCKETS; ++b) {
+        seen += bucket[b];
+        if (seen >= rank && seen)
+            return std::min(upper(b), max_ns);
+    }
+    return max_ns;
+}
+
+void perf_frame_end()
+{
+    uint64_t ns[PERF_STAGES] = {}, calls[PERF_STAGES] = {};
+    {
+        std::lock_guard<std::mutex> guard(registry_lock);
+        for (const perf_thread_counters *c : registry) {
+            for (unsigned s = 0; s < PERF_STAGES; ++s) {
+                ns[s] += c->stage_ns[s].load(std::memory_order_relaxed);
+                calls[s] += c->stage_calls[s].load(std::memory_order_relaxed);
+            }
+        }
+    }
+    for (unsigned s = 0; s < PERF_STAGES; ++s) {
+        if (calls[s] != last_calls[s])
+            histograms[s].add(ns[s] - last_ns[s]);
+        last_ns[s] = ns[s];
+        last_calls[s] = calls[s];
+    }
+    ++frames_ended;
+}
+
+const perf_histogram &perf_stage_stats(perf_stage s)
+{
+    return histograms[s];
+}
+
+uint64_t perf_total(perf_counter c)
+{
+    std::lock_guard<std::mutex> guard(registry_lock);
+    uint64_t n = 0;
+    for (const perf_thread_counters *t : registry)
+        n += t->count[c].load(std::memory_order_relaxed);
+    return n;
+}
+
+uint64_t perf_frames()
+{
+    return frames_ended;
+}
+
+void perf_key_totals(uint64_t (*keys)[1 << 11])
+{
+    memset(keys, 0, 4 * sizeof(keys[0]));
+    std::lock_guard<std::mutex> guard(registry_lock);
+    for (const perf_thread_counters *t : registry)
+        for (unsigned q = 0; q < 4; ++q)
+            for (unsigned k = 0; k < (1 << 11); ++k)
+                keys[q][k] += t->keys[q][k].load(std::memory_order_relaxed);
+}
+
+bool perf_dump(const char *path, unsigned scale)
+{
+    FILE *out = fopen(path, "w");
+    if (!out)
+        return false;
+    const size_t len = strlen(path);
+    const bool json = len >= 5 && strcmp(path + len - 5, ".json") == 0;
+    const std::vector<hqx_rule_branch> rules = hqx_rule_branches(scale);
+    if (json) {
+        fprintf(out, "{\n  \"frames\": %llu,\n  \"stages\": {\n", (unsigned long long)frames_ended);
+        for (unsigned s = 0; s < PERF_STAGES; ++s) {
+            const perf_histogram &h = histograms[s];
+            fprintf(out, "    \"%s\": {\"frames\": %llu, \"mean_ms\": %.4f, \"min_ms\": %.4f, \"max_ms\": %.4f, "
+                         "\"p50_ms\": %.4f, \"p95_ms\": %.4f, \"p99_ms\": %.4f, \"histogram_us\": [",
+                    perf_stage_names[s], (unsigned long long)h.frames, h.frames ? ms(h.total_ns) / h.frames : 0.0,
+                    ms(h.min_ns), ms(h.max_ns), ms(h.percentile(0.5)), ms(h.percentile(0.95)), ms(h.percentile(0.99)));
+            // [upper bound, frames] of the buckets holding any
+            bool first = true;
+            for (unsigned b = 0; b < perf_histogram::BUCKETS; ++b) {
+                if (!h.bucket[b])
+                    continue;
+                fprintf(out, "%s[%.1f, %llu]", first ? "" : ", ", perf_histogram::upper(b) / 1000.0,
+                        (unsigned long long)h.bucket[b]);
+                first = false;
+            }
+            fprintf(out, "]}%s\n", s + 1 < PERF_STAGES ? "," : "");
+        }
+        fprintf(out, "  },\n  \"counters\": {");
+        for (unsigned c = 0; c < PERF_COUNTERS; ++c)
+            fprintf(out, "%s\"%s\": %llu", c ? ", " : "", perf_counter_names[c],
+                    (unsigned long long)perf_total(perf_counter(c)));
+        fprintf(out, "},\n  \"rules\": [\n");
+        for (size_t i = 0; i < rules.size(); ++i) {
+            const hqx_rule_branch &r = rules[i];
+            fprintf(out, "    {\"rule\": \"%s\", \"weights\": [%u, %u, %u], \"pixels\": [%u, %u, %u], \"count\": %llu}%s\n",
+                    r.rule, r.weights[0], r.weights[1], r.weights[2], r.pixels[0], r.pixels[1], r.pixels[2],
+                    (unsigned long long)r.count, i + 1 < rules.size() ? "," : "");
+        }
+        fprintf(out, "  ]\n}\n");
+    } else {
+        // one table per kind of row, told apart by the first column
+        fprintf(out, "stage,name,frames,mean_ms,min_ms,max_ms,p50_ms,p95_ms,p99_ms\n");
+        for (unsigned s = 0; s < PERF_STAGES; ++s) {
+            const perf_histogram &h = histograms[s];
+            fprintf(out, "stage,%s,%llu,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n", perf_stage_names[s],
+                    (unsigned long long)h.frames, h.frames ? ms(h.total_ns) / h.frames : 0.0, ms(h.min_ns),
+                    ms(h.max_ns), ms(h.percentile(0.5)), ms(h.percentile(0.95)), ms(h.percentile(0.99)));
+        }
+        fprintf(out, "histogram,stage,upper_us,frames\n");
+        for (unsigned s = 0; s < PERF_STAGES; ++s)
+            for (unsigned b = 0; b < perf_histogram::BUCKETS; ++b)
+                if (histograms[s].bucket[b])
+                    fprintf(out, "histogram,%s,%.1f,%llu\n", perf_stage_names[s], perf_histogram::upper(b) / 1000.0,
+                            (unsigned long long)histograms[s].bucket[b]);
+        fprintf(out, "counter,name,value\n");
+        for (unsigned c = 0; c < PERF_COUNTERS; ++c)
+            fprintf(out, "counter,%s,%llu\n", perf_counter_names[c], (unsigned long long)perf_total(perf_counter(c)));
+        fprintf(out, "rule,name,weights,pixels,count\n");
+        for (const hqx_rule_branch &r : rules)
+            fprintf(out, "rule,%s,%u/%u/%u,%u %u %u,%llu\n", r.rule, r.weights[0], r.weights[1], r.weights[2],
+                    r.pixels[0], r.pixels[1], r.pixels[2], (unsigned long long)r.count);
+    }
+    const bool ok = !ferror(out);
+    return fclose(out) == 0 && ok;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+
+/* Built-in instrumentation, always compiled in: time spent per pipeline
+ * stage on the monotonic clock, collected into per frame histograms, and
+ * event counters. Counters are per thread, every thread only writes its own
+ * (plain loads and stores, no locked instructions), so the pool workers
+ * never contend; totals are summed when a frame ends. */
+
+enum perf_stage {
+    PERF_FRAME,   // a whole frame of the viewer
+    PERF_TRACK,   // finding the changed cells
+    PERF_RENDER,  // decoding and scaling, with the uploads it does
+    PERF_HQX,     // the hqx filters, CPU time summed over the threads
+    PERF_UPLOAD,  // copies into the texture
+    PERF_PRESENT, // SDL_RenderCopy and SDL_RenderPresent
+    PERF_STAGES
+};
+
+enum perf_counter {
+    PERF_HQX_PIXELS,    // source pixels filtered
+    PERF_HQX_SOLID,     // of them with no diff in their window, filled in one go
+    PERF_UPLOAD_PIXELS, // pixels copied into the texture
+    PERF_COUNTERS
+};
+
+extern const char *const perf_stage_names[PERF_STAGES];
+extern const char *const perf_counter_names[PERF_COUNTERS];
+
+/* the counters of one thread */
+struct perf_thread_counters {
+    std::atomic<uint64_t> stage_ns[PERF_STAGES];
+    std::atomic<uint64_t> stage_calls[PERF_STAGES];
+    std::atomic<uint64_t> count[PERF_COUNTERS];
+    // quadrant keys of the hqx filters, only while perf_count_rules is set
+    std::atomic<uint64_t> keys[4][1 << 11];
+};
+
+/* the calling thread's counters, created on first use */
+perf_thread_counters &perf_local();
+
+/* by the owning thread only */
+inline void perf_add(std::atomic<uint64_t> &c, uint64_t n)
+{
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+inline void perf_count(perf_counter c, uint64_t n)
+{
+    perf_add(perf_local().count[c], n);
+}
+
+/* the hqx rule branches are counted while this is set (see
+ * hqx_rule_branches()), it costs a few increments per pixel */
+extern std::atomic<bool> perf_count_rules;
+
+inline uint64_t perf_now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* times its own lifetime as part of stage s */
+class perf_scope {
+public:
+    explicit perf_scope(perf_stage s) : stage(s), start(perf_now()) {}
+    ~perf_scope()
+    {
+        perf_thread_counters &c = perf_local();
+        perf_add(c.stage_ns[stage], perf_now() - start);
+        perf_add(c.stage_calls[stage], 1);
+    }
+
+private:
+    perf_stage stage;
+    uint64_t start;
+};
+
+/* Per frame times of a stage in log buckets, 4 per octave from 1 us up, so
+ * percentiles are good to about 19%. */
+struct perf_histogram {
+    static const unsigned BUCKETS = 96;
+    static const unsigned RECENT = 64;
+
+    uint64_t bucket[BUCKETS];
+    uint64_t frames, total_ns, min_ns, max_ns;
+    uint64_t recent[RECENT]; // the last frames, recent[frames % RECENT] is the oldest
+
+    void add(uint64_t ns);
+    /* upper bound in ns of the bucket holding the fraction p of the frames */
+    uint64_t percentile(double p) const;
+    /* upper bound in ns of bucket b */
+    static uint64_t upper(unsigned b);
+};
+
+/* Ends the frame: the time every stage took in it, on any thread, goes to
+ * its histogram. Stages that did not run in the frame are left out. Called
+ * by one thread, the one presenting. */
+void perf_frame_end();
+
+/* the histogram of stage s, valid until the next perf_frame_end() */
+const perf_histogram &perf_stage_stats(perf_stage s);
+/* a counter summed over all threads */
+uint64_t perf_total(perf_counter c);
+/* frames ended so far */
+uint64_t perf_frames();
+/* the hqx quadrant keys counted, summed over all threads */
+void perf_key_totals(uint64_t (*keys)[1 << 11]);
+
+/* Writes the stage histograms, the counters and, for scale factor scale,
+ * the hqx rule branches taken, as JSON if path ends in .json, else CSV.
+ * Returns false on I/O errors. */
+bool perf_dump(const char *path, unsigned scale);
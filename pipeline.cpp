@@ -0,0 +1,308 @@
+#include <string.h>
+
+#include <vector>
+
+#include "colors.h"
+#include "hqx.h"
+#include "pipeline.h"
+#include "resample.h"
+#include "thread_pool.h"
+#include "zxscreen.h"
+
+const unsigned WIDTH = MAXX * 8, HEIGHT = MAXY * 8;
+
+/* The renderers produce their output a source line at a time: a producer
+ * starts at line y0 and every next() writes the N output rows of the
+ * following line, pitch pixels apart. The border producers take the colour
+ * per line, the others ignore it. */
+
+template <unsigned N>
+class hqx_lines {
+public:
+    static const unsigned SCALE = N, LINE = WIDTH, LINES = HEIGHT;
+
+    hqx_lines(const uint8_t *p, const uint8_t *a, const uint8_t *, unsigned y0, unsigned f)
+        : pix(p), attr(a), flash(f), y(y0)
+    {
+        if (y0 > 0)
+            zx_decode_line(pix, attr, y0 - 1, ring[(y0 - 1) % 3], flash);
+        zx_decode_line(pix, attr, y0, ring[y0 % 3], flash);
+    }
+
+    void next(uint32_t *out, unsigned pitch)
+    {
+        const uint8_t *cur = ring[y % 3];
+        const uint8_t *prev = y > 0 ? ring[(y + 2) % 3] : cur;
+        const uint8_t *next = cur;
+        if (y < HEIGHT - 1) {
+            zx_decode_line(pix, attr, y + 1, ring[(y + 1) % 3], flash);
+            next = ring[(y + 1) % 3];
+        }
+        hqx_filter_span<N>(prev, cur, next, WIDTH, 0, WIDTH, out, pitch);
+        ++y;
+    }
+
+private:
+    const uint8_t *pix, *attr;
+    unsigned flash, y;
+    uint8_t ring[3][WIDTH];
+};
+
+static void argb_palette(uint32_t palette[16])
+{
+    for (unsigned i = 0; i < 16; ++i) {
+        RGB_pixel rgb;
+        sinc2rgb(rgb, i);
+        palette[i] = rgb2argb(rgb);
+    }
+}
+
+static bool paper_line(unsigned y)
+{
+    return y - ZX_BORDER_TOP < HEIGHT;
+}
+
+/* the output blocks of source pixels [x0, x1) of a line: every window in the
+ * run is the same, so the first block is filtered and copied along */
+template <unsigned N>
+static void filter_run(const uint8_t *prev, const uint8_t *cur, const uint8_t *next, unsigned x0, unsigned x1,
+                       uint32_t *out, unsigned pitch)
+{
+    hqx_filter_span<N>(prev, cur, next, ZX_BORDER_W, x0, x0 + 1, out + x0 * N, pitch);
+    for (unsigned r = 0; r < N; ++r) {
+        uint32_t *line = out + r * pitch;
+        for (unsigned x = (x0 + 1) * N; x < x1 * N; ++x)
+            line[x] = line[x - N];
+    }
+}
+
+template <unsigned N>
+class border_hqx_lines {
+public:
+    static const unsigned SCALE = N, LINE = ZX_BORDER_W, LINES = ZX_BORDER_H;
+
+    border_hqx_lines(const uint8_t *p, const uint8_t *a, const uint8_t *b, unsigned y0, unsigned f)
+        : pix(p), attr(a), border(b), flash(f), y(y0)
+    {
+        if (y0 > 0)
+            zx_decode_border_line(pix, attr, border, y0 - 1, ring[(y0 - 1) % 3], flash);
+        zx_decode_border_line(pix, attr, border, y0, ring[y0 % 3], flash);
+    }
+
+    void next(uint32_t *out, unsigned pitch)
+    {
+        const unsigned right = ZX_BORDER_LEFT + WIDTH;
+        const unsigned yp = y > 0 ? y - 1 : y, yn = y < ZX_BORDER_H - 1 ? y + 1 : y;
+        const uint8_t *cur = ring[y % 3], *prev = ring[yp % 3], *next = ring[yn % 3];
+        if (yn != y)
+            zx_decode_border_line(pix, attr, border, yn, ring[yn % 3], flash);
+        // every line is uniform outside the paper columns, the windows that
+        // see no paper line form runs of the same neighbourhood
+        if (!paper_line(yp) && !paper_line(y) && !paper_line(yn)) {
+            filter_run<N>(prev, cur, next, 0, ZX_BORDER_W, out, pitch);
+        } else {
+            filter_run<N>(prev, cur, next, 0, ZX_BORDER_LEFT - 1, out, pitch);
+            hqx_filter_span<N>(prev, cur, next, ZX_BORDER_W, ZX_BORDER_LEFT - 1, right + 1,
+                               out + (ZX_BORDER_LEFT - 1) * N, pitch);
+            filter_run<N>(prev, cur, next, right + 1, ZX_BORDER_W, out, pitch);
+        }
+        ++y;
+    }
+
+private:
+    const uint8_t *pix, *attr, *border;
+    unsigned flash, y;
+    uint8_t ring[3][ZX_BORDER_W];
+};
+
+/* plain N x N pixel blocks, of the screen or with the border */
+template <unsigned N, bool BORDER>
+class nx_lines {
+public:
+    static const unsigned SCALE = N, LINE = BORDER ? ZX_BORDER_W : WIDTH, LINES = BORDER ? ZX_BORDER_H : HEIGHT;
+
+    nx_lines(const uint8_t *p, const uint8_t *a, const uint8_t *b, unsigned y0, unsigned f)
+        : pix(p), attr(a), border(b), flash(f), y(y0)
+    {
+        argb_palette(palette);
+    }
+
+    void next(uint32_t *out, unsigned pitch)
+    {
+        uint8_t line[LINE];
+        if (BORDER)
+            zx_decode_border_line(pix, attr, border, y, line, flash);
+        else
+            zx_decode_line(pix, attr, y, line, flash);
+        for (unsigned x = 0; x < LINE; ++x)
+            for (unsigned i = 0; i < N; ++i)
+                out[x * N + i] = palette[line[x]];
+        for (unsigned j = 1; j < N; ++j)
+            memcpy(out + j * pitch, out, LINE * N * sizeof(uint32_t));
+        ++y;
+    }
+
+private:
+    const uint8_t *pix, *attr, *border;
+    unsigned flash, y;
+    uint32_t palette[16];
+};
+
+/* source lines [y0, y1) of a producer into dst */
+template <class Lines>
+static void render(const uint8_t *pix, const uint8_t *attr, const uint8_t *border, uint32_t *dst,
+                   unsigned pitch, unsigned y0, unsigned y1, unsigned flash)
+{
+    Lines lines(pix, attr, border, y0, flash);
+    for (unsigned y = y0; y < y1; ++y)
+        lines.next(dst + y * Lines::SCALE * pitch, pitch);
+}
+
+template <class Lines>
+static void render_pool(thread_pool &pool, const uint8_t *pix, const uint8_t *attr, const uint8_t *border,
+                        uint32_t *dst, unsigned pitch, unsigned flash)
+{
+    const unsigned bands = pool.size();
+    pool.run(bands, [=](unsigned band) {
+        render<Lines>(pix, attr, border, dst, pitch, Lines::LINES * band / bands,
+                      Lines::LINES * (band + 1) / bands, flash);
+    });
+}
+
+/* Picture rows [y0, y1) of r: the source lines they read are produced one
+ * at a time into a strip of N rows and filtered horizontally into a ring
+ * holding the rows the next picture row needs and one strip more, every
+ * picture row is written as soon as its rows are in. */
+template <class Lines>
+static void render_fit(const uint8_t *pix, const uint8_t *attr, const uint8_t *border, const resampler &r,
+                       uint32_t *dst, unsigned pitch, unsigned y0, unsigned y1, unsigned flash)
+{
+    const unsigned n = Lines::SCALE, width = Lines::LINE * n, slots = r.taps_y + n;
+    const unsigned need0 = r.first_row(y0), need1 = r.first_row(y1 - 1) + r.taps_y;
+    std::vector<uint32_t> strip(n * width), ring(slots * r.w);
+    std::vector<const uint32_t *> rows(r.taps_y);
+    Lines lines(pix, attr, border, need0 / n, flash);
+    unsigned done = need0, y = y0;
+    for (unsigned line = need0 / n; y < y1; ++line) {
+        lines.next(strip.data(), width);
+        for (unsigned i = 0; i < n; ++i) {
+            const unsigned row = line * n + i;
+            if (row < need0 || row >= need1)
+                continue;
+            r.horizontal(&strip[i * width], &ring[row % slots * r.w]);
+            done = row + 1;
+        }
+        for (; y < y1 && r.first_row(y) + r.taps_y <= done; ++y) {
+            for (unsigned j = 0; j < r.taps_y; ++j)
+                rows[j] = &ring[(r.first_row(y) + j) % slots * r.w];
+            r.vertical(y, rows.data(), dst + (r.y0 + y) * pitch);
+        }
+    }
+}
+
+template <class Lines>
+static void render_fit_pool(thread_pool &pool, const uint8_t *pix, const uint8_t *attr, const uint8_t *border,
+                            const resampler &r, uint32_t *dst, unsigned pitch, unsigned flash)
+{
+    r.clear(dst, pitch);
+    const unsigned bands = pool.size();
+    pool.run(bands, [&](unsigned band) {
+        const unsigned y0 = r.h * band / bands, y1 = r.h * (band + 1) / bands;
+        if (y0 < y1)
+            render_fit<Lines>(pix, attr, border, r, dst, pitch, y0, y1, flash);
+    });
+}
+
+template <unsigned N>
+static void render_hqx(const uint8_t *pix, const uint8_t *attr, uint32_t *dst, unsigned pitch,
+                       unsigned y0, unsigned y1, unsigned flash)
+{
+    render<hqx_lines<N> >(pix, attr, NULL, dst, pitch, y0, y1, flash);
+}
+
+template <unsigned N>
+static void render_nx(const uint8_t *pix, const uint8_t *attr, uint32_t *dst, unsigned pitch,
+                      unsigned y0, unsigned y1, unsigned flash)
+{
+    render<nx_lines<N, false> >(pix, attr, NULL, dst, pitch, y0, y1, flash);
+}
+
+template <unsigned N>
+static void render_hqx_pool(thread_pool &pool, const uint8_t *pix, const uint8_t *attr, uint32_t *dst,
+                            unsigned pitch, unsigned flash)
+{
+    render_pool<hqx_lines<N> >(pool, pix, attr, NULL, dst, pitch, flash);
+}
+
+template <unsigned N>
+static void render_fit_any(thread_pool &pool, const uint8_t *pix, const uint8_t *attr, const uint8_t *border,
+                           bool hqx, const resampler &r, uint32_t *dst, unsigned pitch, unsigned flash)
+{
+    if (border && hqx)
+        render_fit_pool<border_hqx_lines<N> >(pool, pix, attr, border, r, dst, pitch, flash);
+    else if (border)
+        render_fit_pool<nx_lines<N, true> >(pool, pix, attr, border, r, dst, pitch, flash);
+    else if (hqx)
+        render_fit_pool<hqx_lines<N> >(pool, pix, attr, NULL, r, dst, pitch, flash);
+    else
+        render_fit_pool<nx_lines<N, false> >(pool, pix, attr, NULL, r, dst, pitch, flash);
+}
+
+template <unsigned N>
+static zx_scaler make_scaler()
+{
+    const zx_scaler s = {
+        N,
+        render_hqx<N>, render_nx<N>, render_hqx_pool<N>,
+        render<border_hqx_lines<N> >, render<nx_lines<N, true> >, render_pool<border_hqx_lines<N> >,
+        render_fit_any<N>,
+        hqx_filter<N>, hqx_filter<N>, hqx_filter<N>, hqx_filter<N>, hqx_filter_rect<N>, hqx_filter_ref<N>,
+    };
+    return s;
+}
+
+static const zx_scaler scalers[] = {make_scaler<2>(), make_scaler<3>(), make_scaler<4>()};
+
+const zx_scaler *zx_scaler_for(unsigned scale)
+{
+    for (const zx_scaler &s : scalers)
+        if (s.scale == scale)
+            return &s;
+    return NULL;
+}
+
+void zx_render_hq4x(const uint8_t *pix, const uint8_t *attr, uint32_t *dst, unsigned pitch,
+                    unsigned y0, unsigned y1, unsigned flash)
+{
+    render_hqx<4>(pix, attr, dst, pitch, y0, y1, flash);
+}
+
+void zx_render_4x(const uint8_t *pix, const uint8_t *attr, uint32_t *dst, unsigned pitch,
+                  unsigned y0, unsigned y1, unsigned flash)
+{
+    render_nx<4>(pix, attr, dst, pitch, y0, y1, flash);
+}
+
+void zx_render_hq4x(thread_pool &pool, const uint8_t *pix, const uint8_t *attr, uint32_t *dst, unsigned pitch,
+                    unsigned flash)
+{
+    render_hqx_pool<4>(pool, pix, attr, dst, pitch, flash);
+}
+
+void zx_render_border_hq4x(const uint8_t *pix, const uint8_t *attr, const uint8_t *border, uint32_t *dst,
+                           unsigned pitch, unsigned y0, unsigned y1, unsigned flash)
+{
+    render<border_hqx_lines<4> >(pix, attr, border, dst, pitch, y0, y1, flash);
+}
+
+void zx_render_border_4x(const uint8_t *pix, const uint8_t *attr, const uint8_t *border, uint32_t *dst,
+                         unsigned pitch, unsigned y0, unsigned y1, unsigned flash)
+{
+    render<nx_lines<4, true> >(pix, attr, border, dst, pitch, y0, y1, flash);
+}
+
+void zx_render_border_hq4x(thread_pool &pool, const uint8_t *pix, const uint8_t *attr, const uint8_t *border,
+                           uint32_t *dst, unsigned pitch, unsigned flash)
+{
+    render_pool<border_hqx_lines<4> >(pool, pix, attr, border, dst, pitch, flash);
+}
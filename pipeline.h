@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "colors.h"
+
+class resampler;
+class thread_pool;
+
+/* Fused screen -> display pipelines: the screen is decoded a line at a time
+ * into a ring of 3 lines and every line is scaled straight into dst (pitch in
+ * pixels, e.g. a locked texture), so no full frame buffer is touched on the
+ * way. */
+
+/* source lines [y0, y1) of the hq4x upscaled screen in flash phase flash */
+void zx_render_hq4x(const uint8_t *pix, const uint8_t *attr, uint32_t *dst, unsigned pitch,
+                    unsigned y0, unsigned y1, unsigned flash = 0);
+
+/* source lines [y0, y1) as plain 4x4 pixel blocks */
+void zx_render_4x(const uint8_t *pix, const uint8_t *attr, uint32_t *dst, unsigned pitch,
+                  unsigned y0, unsigned y1, unsigned flash = 0);
+
+/* the whole screen, split into line bands over the pool threads */
+void zx_render_hq4x(thread_pool &pool, const uint8_t *pix, const uint8_t *attr, uint32_t *dst, unsigned pitch,
+                    unsigned flash = 0);
+
+/* Border mode, the 320x240 screen with the border (see zxscreen.h) scaled to
+ * 1280x960: border holds the colour of each of the 240 lines and y0, y1 are
+ * lines of that frame. The uniform border runs are filtered once and
+ * repeated. */
+void zx_render_border_hq4x(const uint8_t *pix, const uint8_t *attr, const uint8_t *border, uint32_t *dst,
+                           unsigned pitch, unsigned y0, unsigned y1, unsigned flash = 0);
+void zx_render_border_4x(const uint8_t *pix, const uint8_t *attr, const uint8_t *border, uint32_t *dst,
+                         unsigned pitch, unsigned y0, unsigned y1, unsigned flash = 0);
+void zx_render_border_hq4x(thread_pool &pool, const uint8_t *pix, const uint8_t *attr, const uint8_t *border,
+                           uint32_t *dst, unsigned pitch, unsigned flash = 0);
+
+/* All of the above and the frame filters for one scale factor N, to pick
+ * the factor at run time: the output is N times the source (the screen, or
+ * 320x240 for the border renderers) and every function is compiled for its
+ * factor. */
+struct zx_scaler {
+    unsigned scale;
+    void (*hqx)(const uint8_t *pix, const uint8_t *attr, uint32_t *dst, unsigned pitch,
+                unsigned y0, unsigned y1, unsigned flash);
+    void (*nx)(const uint8_t *pix, const uint8_t *attr, uint32_t *dst, unsigned pitch,
+               unsigned y0, unsigned y1, unsigned flash);
+    void (*hqx_pool)(thread_pool &pool, const uint8_t *pix, const uint8_t *attr, uint32_t *dst, unsigned pitch,
+                     unsigned flash);
+    void (*border_hqx)(const uint8_t *pix, const uint8_t *attr, const uint8_t *border, uint32_t *dst,
+                       unsigned pitch, unsigned y0, unsigned y1, unsigned flash);
+    void (*border_nx)(const uint8_t *pix, const uint8_t *attr, const uint8_t *border, uint32_t *dst,
+                      unsigned pitch, unsigned y0, unsigned y1, unsigned flash);
+    void (*border_hqx_pool)(thread_pool &pool, const uint8_t *pix, const uint8_t *attr, const uint8_t *border,
+                            uint32_t *dst, unsigned pitch, unsigned flash);
+    /* the screen, or the 320x240 frame if border is not NULL, hqx or in plain
+     * blocks and resampled on the fly to the display size of r over the
+     * pool: dst is r.dst_w x r.dst_h with the picture at (r.x0, r.y0) */
+    void (*fit)(thread_pool &pool, const uint8_t *pix, const uint8_t *attr, const uint8_t *border, bool hqx,
+                const resampler &r, uint32_t *dst, unsigned pitch, unsigned flash);
+    /* hqx_filter<N>, hqx_filter_rect<N> and hqx_filter_ref<N> */
+    void (*filter)(const uint8_t *src, uint32_t *dst, unsigned width, unsigned height);
+    void (*filter_yuv)(const uint8_t *src, YUV_pixel *dst, unsigned width, unsigned height);
+    void (*filter_pool)(thread_pool &pool, const uint8_t *src, uint32_t *dst, unsigned width, unsigned height);
+    void (*filter_yuv_pool)(thread_pool &pool, const uint8_t *src, YUV_pixel *dst, unsigned width,
+                            unsigned height);
+    void (*filter_rect)(const uint8_t *src, uint32_t *dst, unsigned width, unsigned height,
+                        unsigned x0, unsigned y0, unsigned x1, unsigned y1);
+    void (*filter_ref)(const uint8_t *src, YUV_pixel *dst, unsigned width, unsigned height);
+};
+
+/* the scaler of factor 2, 3 or 4, NULL for any other */
+const zx_scaler *zx_scaler_for(unsigned scale);
@@ -0,0 +1,124 @@
+#include <string.h>
+
+#include "perf.h"
+#include "pipeline.h"
+#include "render_thread.h"
+#include "resample.h"
+
+triple_buffer::triple_buffer() : dropped(0), newest(2), writing(0), reading(1)
+{
+}
+
+void triple_buffer::publish()
+{
+    // the exchange releases the frame drawn and acquires the one to draw next
+    const unsigned old = newest.exchange(writing | FRESH);
+    dropped += (old & FRESH) != 0;
+    writing = old & ~FRESH;
+}
+
+const rendered_frame *triple_buffer::take()
+{
+    if (!(newest.load() & FRESH))
+        return NULL;
+    reading = newest.exchange(reading) & ~FRESH;
+    return &frame[reading];
+}
+
+render_thread::render_thread(const zx_scaler &sc, thread_pool &p, frame_ring *r, const zx_frame *scr,
+                             const render_settings &s, const std::function<void()> &f)
+    : scaler(sc), pool(p), ring(r), screen(scr), ready(f), settings(s), changed(true), quit(false)
+{
+    worker = std::thread(&render_thread::run, this);
+}
+
+render_thread::~render_thread()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        quit = true;
+    }
+    wake.notify_one();
+    if (ring)
+        ring->wake();
+    worker.join();
+}
+
+void render_thread::request(const render_settings &s)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        settings = s;
+        changed = true;
+    }
+    wake.notify_one();
+    if (ring)
+        ring->wake();
+}
+
+void render_thread::run()
+{
+    const zx_frame *frame = ring ? NULL : screen;
+    for (;;) {
+        render_settings s;
+        bool redraw;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            // with a ring the thread sleeps in ring->wait() below instead
+            if (!ring)
+                wake.wait(guard, [this] {return changed || quit;});
+            if (quit)
+                return;
+            redraw = changed;
+            changed = false;
+            s = settings;
+        }
+        if (ring) {
+            if (const zx_frame *f = ring->take()) {
+                frame = f;
+                redraw = true;
+            }
+        }
+        if (!redraw || !frame) {
+            // until the producer publishes a frame or request() or quitting
+            // wake() the ring
+            if (ring)
+                ring->wait();
+            continue;
+        }
+        draw(*frame, s, frames.back());
+        frames.publish();
+        ready();
+    }
+}
+
+void render_thread::draw(const zx_frame &f, const render_settings &s, rendered_frame &out)
+{
+    perf_scope timed(PERF_RENDER);
+    out.width = s.fit ? s.fit->dst_w : (s.bordered ? ZX_BORDER_W : MAXX * 8) * scaler.scale;
+    out.height = s.fit ? s.fit->dst_h : (s.bordered ? ZX_BORDER_H : MAXY * 8) * scaler.scale;
+    out.generation = s.generation;
+    uint8_t lines[ZX_BORDER_H];
+    for (unsigned y = 0; y < ZX_BORDER_H; ++y)
+        lines[y] = ring ? f.border[y] & 0b111 : s.border;
+    for (unsigned hqx = 0; hqx < 2; ++hqx) {
+        out.pixels[hqx].resize(out.width * out.height);
+        uint32_t *dst = out.pixels[hqx].data();
+        if (s.fit) {
+            scaler.fit(pool, &f.pix[0][0], &f.attr[0][0], s.bordered ? lines : NULL, hqx, *s.fit, dst, out.width,
+                       s.flash);
+        } else if (s.bordered) {
+            if (hqx)
+                scaler.border_hqx_pool(pool, &f.pix[0][0], &f.attr[0][0], lines, dst, out.width, s.flash);
+            else
+                scaler.border_nx(&f.pix[0][0], &f.attr[0][0], lines, dst, out.width, 0, ZX_BORDER_H, s.flash);
+        } else if (hqx) {
+            scaler.hqx_pool(pool, &f.pix[0][0], &f.attr[0][0], dst, out.width, s.flash);
+        } else {
+            scaler.nx(&f.pix[0][0], &f.attr[0][0], dst, out.width, 0, MAXY * 8, s.flash);
+        }
+    }
+    out.flashing = false;
+    for (unsigned i = 0; i < MAXX * MAXY && !out.flashing; ++i)
+        out.flashing = (&f.attr[0][0])[i] & 0x80;
+}
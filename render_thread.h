@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "frame_ring.h"
+
+class resampler;
+class thread_pool;
+struct zx_scaler;
+
+/* what the render thread draws, set by the presenting thread */
+struct render_settings {
+    bool bordered;        // the 320x240 screen with the border
+    uint8_t border;       // border colour of a static screen, live frames carry their own
+    const resampler *fit; // resampled to its dst size if not NULL
+    unsigned flash;       // phase
+    uint64_t generation;  // of the request, frames drawn with it carry it back
+};
+
+/* a frame upscaled with both algorithms as produced by the render thread */
+struct rendered_frame {
+    std::vector<uint32_t> pixels[2]; // plain pixel multiply and hqx, ARGB8888, width pixels per row
+    unsigned width;
+    unsigned height;
+    uint64_t generation;
+    bool flashing; // a cell has the FLASH attribute
+};
+
+/* Three frames shared by one producer and one consumer without locks: each
+ * side owns one and the third is the newest complete frame. Publishing and
+ * taking swap the own frame with the third, so neither side ever waits and
+ * the consumer always gets the newest frame; frames it did not get to are
+ * drawn over. */
+class triple_buffer {
+public:
+    triple_buffer();
+
+    /* producer: the frame to draw, then publish() makes it the newest */
+    rendered_frame &back() {return frame[writing];}
+    void publish();
+
+    /* consumer: the newest frame if it was published after the last one
+     * taken, else NULL. It stays untouched until the next take(). */
+    const rendered_frame *take();
+
+    /* frames published but never taken, counted by the producer */
+    uint64_t dropped;
+
+private:
+    static const unsigned FRESH = 4;
+
+    rendered_frame frame[3];
+    std::atomic<unsigned> newest; // frame index | FRESH until taken
+    unsigned writing;
+    unsigned reading;
+};
+
+/* Decodes and upscales frames on a thread of its own: the newest frame of
+ * the live ring, or a static screen whenever the settings change. Frames are
+ * handed over through a triple_buffer, so the presenting thread only uploads
+ * and handles events and a fast frame source is never held up by vsync. */
+class render_thread {
+public:
+    /* frames come from ring if it is not NULL, else from screen, the first
+     * one is drawn with s; ready() is called on the render thread after
+     * every frame published */
+    render_thread(const zx_scaler &scaler, thread_pool &pool, frame_ring *ring, const zx_frame *screen,
+                  const render_settings &s, const std::function<void()> &ready);
+    /* stops after the frame being drawn */
+    ~render_thread();
+
+    /* draws the next frame with s, the current one is finished first */
+    void request(const render_settings &s);
+
+    triple_buffer frames;
+
+private:
+    void run();
+    void draw(const zx_frame &f, const render_settings &s, rendered_frame &out);
+
+    const zx_scaler &scaler;
+    thread_pool &pool;
+    frame_ring *ring;
+    const zx_frame *screen;
+    std::function<void()> ready;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    render_settings settings;
+    bool changed;
+    bool quit;
+    std::thread worker;
+};
@@ -0,0 +1,185 @@
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "resample.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const int ONE = 1 << 14;
+/* shrinking by more than 7.5 leaves out samples rather than taking more */
+const unsigned MAX_TAPS = 32;
+const uint32_t BLACK = 0xff000000u;
+
+double catmull_rom(double x)
+{
+    x = fabs(x);
+    if (x < 1)
+        return (1.5 * x - 2.5) * x * x + 1;
+    if (x < 2)
+        return ((-0.5 * x + 2.5) * x - 4) * x + 2;
+    return 0;
+}
+
+/* taps for n_out samples over n_in: every output has the same even number of
+ * taps from first[i] on, all inside [0, n_in); taps falling off the edges
+ * are folded onto the edge sample. Returns the number of taps. */
+unsigned make_taps(unsigned n_in, unsigned n_out, std::vector<unsigned> &first, std::vector<int16_t> &weight)
+{
+    const double ratio = double(n_in) / n_out;
+    const double stretch = std::min(std::max(ratio, 1.0), (MAX_TAPS - 2) / 4.0), support = 2 * stretch;
+    unsigned taps = (unsigned(ceil(2 * support)) + 1) & ~1u;
+    if (taps > n_in)
+        taps = n_in & ~1u;
+    first.resize(n_out);
+    weight.assign(n_out * taps, 0);
+    std::vector<double> w(taps);
+    for (unsigned i = 0; i < n_out; ++i) {
+        const double centre = (i + 0.5) * ratio - 0.5;
+        const int left = int(floor(centre - support)) + 1;
+        const int start = left < 0 ? 0 : left + taps > n_in ? n_in - taps : left;
+        std::fill(w.begin(), w.end(), 0.0);
+        double sum = 0;
+        for (int k = left; k < left + int(2 * support) + 1; ++k) {
+            const double v = catmull_rom((k - centre) / stretch);
+            const int at = k < 0 ? 0 : k >= int(n_in) ? n_in - 1 : k;
+            if (at - start < 0 || at - start >= int(taps))
+                continue;
+            w[at - start] += v;
+            sum += v;
+        }
+        // the rounding error goes to the largest tap, so a flat area stays flat
+        int16_t *out = &weight[i * taps];
+        int total = 0;
+        unsigned largest = 0;
+        for (unsigned j = 0; j < taps; ++j) {
+            out[j] = int16_t(lround(w[j] / sum * ONE));
+            total += out[j];
+            if (out[j] > out[largest])
+                largest = j;
+        }
+        out[largest] += ONE - total;
+        first[i] = start;
+    }
+    return taps;
+}
+
+inline uint8_t clamp8(int v)
+{
+    v = (v + ONE / 2) >> 14;
+    return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+#if defined(__SSE2__)
+/* 4 int32 channel sums of 2.14 weighted pixels -> packed ARGB, clamped */
+inline uint32_t pack(__m128i acc)
+{
+    acc = _mm_srai_epi32(_mm_add_epi32(acc, _mm_set1_epi32(ONE / 2)), 14);
+    const __m128i v = _mm_packs_epi32(acc, acc);
+    return _mm_cvtsi128_si32(_mm_packus_epi16(v, v));
+}
+
+inline __m128i pair_weight(const int16_t *w)
+{
+    int32_t pair;
+    memcpy(&pair, w, sizeof(pair));
+    return _mm_set1_epi32(pair);
+}
+#endif
+
+}
+
+resampler::resampler(unsigned sw, unsigned sh, unsigned dw, unsigned dh)
+    : src_w(sw), src_h(sh), dst_w(dw), dst_h(dh)
+{
+    // the largest picture of the source's aspect ratio that fits
+    if (uint64_t(dw) * sh <= uint64_t(dh) * sw) {
+        w = dw;
+        h = uint64_t(dw) * sh / sw;
+    } else {
+        h = dh;
+        w = uint64_t(dh) * sw / sh;
+    }
+    x0 = (dw - w) / 2;
+    y0 = (dh - h) / 2;
+    taps_x = make_taps(sw, w, col_first, col_weight);
+    taps_y = make_taps(sh, h, row_first, row_weight);
+}
+
+void resampler::horizontal(const uint32_t *src, uint32_t *out) const
+{
+    for (unsigned x = 0; x < w; ++x) {
+        const uint32_t *p = src + col_first[x];
+        const int16_t *wt = &col_weight[x * taps_x];
+#if defined(__SSE2__)
+        // two taps per madd: b0 b1 g0 g1 r0 r1 a0 a1 times w0 w1 w0 w1 ...
+        __m128i acc = _mm_setzero_si128();
+        for (unsigned j = 0; j < taps_x; j += 2) {
+            const __m128i px = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p + j)),
+                                                 _mm_setzero_si128());
+            const __m128i pairs = _mm_unpacklo_epi16(px, _mm_srli_si128(px, 8));
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(pairs, pair_weight(wt + j)));
+        }
+        out[x] = pack(acc);
+#else
+        int acc[4] = {0, 0, 0, 0};
+        for (unsigned j = 0; j < taps_x; ++j)
+            for (unsigned c = 0; c < 4; ++c)
+                acc[c] += wt[j] * int(p[j] >> (c * 8) & 0xff);
+        out[x] = clamp8(acc[0]) | clamp8(acc[1]) << 8 | clamp8(acc[2]) << 16 | uint32_t(clamp8(acc[3])) << 24;
+#endif
+    }
+}
+
+void resampler::vertical(unsigned y, const uint32_t *const *rows, uint32_t *out) const
+{
+    const int16_t *wt = &row_weight[y * taps_y];
+    for (unsigned x = 0; x < x0; ++x)
+        out[x] = BLACK;
+    out += x0;
+    unsigned x = 0;
+#if defined(__SSE2__)
+    // 4 pixels of 2 rows per step, interleaved per channel like horizontal()
+    const __m128i zero = _mm_setzero_si128();
+    __m128i weight[MAX_TAPS / 2];
+    for (unsigned j = 0; j < taps_y; j += 2)
+        weight[j / 2] = pair_weight(wt + j);
+    for (; x + 4 <= w; x += 4) {
+        __m128i acc[4] = {zero, zero, zero, zero};
+        for (unsigned j = 0; j < taps_y; j += 2) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[j] + x));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[j + 1] + x));
+            const __m128i weights = weight[j / 2];
+            const __m128i alo = _mm_unpacklo_epi8(a, zero), blo = _mm_unpacklo_epi8(b, zero);
+            const __m128i ahi = _mm_unpackhi_epi8(a, zero), bhi = _mm_unpackhi_epi8(b, zero);
+            acc[0] = _mm_add_epi32(acc[0], _mm_madd_epi16(_mm_unpacklo_epi16(alo, blo), weights));
+            acc[1] = _mm_add_epi32(acc[1], _mm_madd_epi16(_mm_unpackhi_epi16(alo, blo), weights));
+            acc[2] = _mm_add_epi32(acc[2], _mm_madd_epi16(_mm_unpacklo_epi16(ahi, bhi), weights));
+            acc[3] = _mm_add_epi32(acc[3], _mm_madd_epi16(_mm_unpackhi_epi16(ahi, bhi), weights));
+        }
+        for (unsigned i = 0; i < 4; ++i)
+            out[x + i] = pack(acc[i]);
+    }
+#endif
+    for (; x < w; ++x) {
+        int acc[4] = {0, 0, 0, 0};
+        for (unsigned j = 0; j < taps_y; ++j)
+            for (unsigned c = 0; c < 4; ++c)
+                acc[c] += wt[j] * int(rows[j][x] >> (c * 8) & 0xff);
+        out[x] = clamp8(acc[0]) | clamp8(acc[1]) << 8 | clamp8(acc[2]) << 16 | uint32_t(clamp8(acc[3])) << 24;
+    }
+    for (x = w; x < dst_w - x0; ++x)
+        out[x] = BLACK;
+}
+
+void resampler::clear(uint32_t *dst, unsigned pitch) const
+{
+    for (unsigned y = 0; y < dst_h; ++y)
+        if (y < y0 || y >= y0 + h)
+            std::fill(dst + y * pitch, dst + y * pitch + dst_w, BLACK);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+/* Separable Catmull-Rom resampling of an upscaled frame to any display size.
+ * The frame keeps its aspect ratio: it is scaled to the largest rectangle
+ * that fits and centred, the bars around it are black. The filter taps are
+ * 2.14 fixed point and precomputed per output column and row, widened when
+ * shrinking. Rows are filtered horizontally one at a time as they are
+ * produced, so the fused renderers (zx_scaler::fit) only keep a few of them
+ * and never a full frame. */
+class resampler {
+public:
+    resampler(unsigned src_w, unsigned src_h, unsigned dst_w, unsigned dst_h);
+
+    unsigned src_w, src_h, dst_w, dst_h;
+    /* the picture inside dst */
+    unsigned x0, y0, w, h;
+    /* taps per output pixel and row, even */
+    unsigned taps_x, taps_y;
+
+    /* picture row y reads source rows first_row(y) .. first_row(y) + taps_y - 1 */
+    unsigned first_row(unsigned y) const {return row_first[y];}
+
+    /* the w picture pixels of a src_w pixel source row */
+    void horizontal(const uint32_t *src, uint32_t *out) const;
+
+    /* picture row y from its taps_y horizontally filtered source rows, out
+     * is the whole dst row including the bars left and right */
+    void vertical(unsigned y, const uint32_t *const *rows, uint32_t *out) const;
+
+    /* the bars above and below the picture */
+    void clear(uint32_t *dst, unsigned pitch) const;
+
+private:
+    std::vector<unsigned> col_first, row_first;
+    std::vector<int16_t> col_weight, row_weight; // taps_x per column, taps_y per row
+};
@@ -0,0 +1,454 @@
+/* Benchmark of the pipeline stages over a set of screen files: every stage
+ * is timed on its own for every screen and reported as ns/pixel, frames/s
+ * and the spread of the frame times. The resampling to a display size is
+ * also compared for quality with the scaling SDL does. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifdef HAVE_SDL
+#include <SDL2/SDL.h>
+#endif
+
+#include "colors.h"
+#include "hqx.h"
+#include "pipeline.h"
+#include "resample.h"
+#include "snapshot.h"
+#include "thread_pool.h"
+#include "tile_cache.h"
+#include "zxscreen.h"
+
+const unsigned SRC_W = MAXX*8, SRC_H = MAXY*8;
+
+struct screen {
+    std::string name;
+    std::vector<uint8_t> data;
+};
+
+struct stage {
+    const char *name;
+    unsigned pixels;    // pixels produced per frame, for ns/pixel
+    std::function<void(const screen &)> run;
+};
+
+struct stats {
+    double mean, stddev, min;
+};
+
+static stats measure(const std::function<void()> &fn, unsigned iterations)
+{
+    std::vector<double> ns;
+    fn();   // warm up caches and tables
+    for (unsigned i = 0; i < iterations; ++i) {
+        auto t0 = std::chrono::steady_clock::now();
+        fn();
+        auto t1 = std::chrono::steady_clock::now();
+        ns.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count());
+    }
+    stats s = {0, 0, *std::min_element(ns.begin(), ns.end())};
+    for (double v : ns)
+        s.mean += v;
+    s.mean /= ns.size();
+    for (double v : ns)
+        s.stddev += (v - s.mean) * (v - s.mean);
+    s.stddev = sqrt(s.stddev / ns.size());
+    return s;
+}
+
+/* Lanczos-3 in double precision, the reference the resamplers are measured
+ * against: src (sw x sh) to the w x h picture in out, 4 channels each */
+static void lanczos3(const std::vector<uint32_t> &src, unsigned sw, unsigned sh, unsigned w, unsigned h,
+                     std::vector<double> &out)
+{
+    struct tap {
+        unsigned at;
+        double weight;
+    };
+    auto taps = [](unsigned n_in, unsigned n_out, unsigned i, std::vector<tap> &t) {
+        const double ratio = double(n_in) / n_out, stretch = ratio > 1 ? ratio : 1;
+        const double centre = (i + 0.5) * ratio - 0.5, support = 3 * stretch;
+        double sum = 0;
+        t.clear();
+        for (int k = int(ceil(centre - support)); k <= int(floor(centre + support)); ++k) {
+            const double x = (k - centre) / stretch;
+            const double v = x == 0 ? 1 : fabs(x) >= 3 ? 0 : 3 * sin(M_PI * x) * sin(M_PI * x / 3) / (M_PI * M_PI * x * x);
+            t.push_back({unsigned(k < 0 ? 0 : k >= int(n_in) ? n_in - 1 : k), v});
+            sum += v;
+        }
+        for (tap &p : t)
+            p.weight /= sum;
+    };
+    std::vector<double> rows(sh * w * 4);
+    std::vector<tap> t;
+    for (unsigned x = 0; x < w; ++x) {
+        taps(sw, w, x, t);
+        for (unsigned y = 0; y < sh; ++y)
+            for (unsigned c = 0; c < 4; ++c) {
+                double v = 0;
+                for (const tap &p : t)
+                    v += p.weight * (src[y * sw + p.at] >> (c * 8) & 0xff);
+                rows[(y * w + x) * 4 + c] = v;
+            }
+    }
+    out.assign(h * w * 4, 0);
+    for (unsigned y = 0; y < h; ++y) {
+        taps(sh, h, y, t);
+        for (unsigned x = 0; x < w * 4; ++x) {
+            double v = 0;
+            for (const tap &p : t)
+                v += p.weight * rows[p.at * w * 4 + x];
+            out[y * w * 4 + x] = v < 0 ? 0 : v > 255 ? 255 : v;
+        }
+    }
+}
+
+/* reported for identical pictures, whose PSNR is infinite */
+static const double PSNR_MAX = 99;
+
+/* PSNR of the picture at (x0, y0) in dst (pitch pixels) against ref, at most
+ * PSNR_MAX */
+static double psnr(const uint32_t *dst, unsigned pitch, unsigned x0, unsigned y0, unsigned w, unsigned h,
+                   const std::vector<double> &ref)
+{
+    double se = 0;
+    for (unsigned y = 0; y < h; ++y)
+        for (unsigned x = 0; x < w; ++x)
+            for (unsigned c = 0; c < 3; ++c) {
+                const double d = (dst[(y0 + y) * pitch + x0 + x] >> (c * 8) & 0xff) - ref[(y * w + x) * 4 + c];
+                se += d * d;
+            }
+    if (se == 0)
+        return PSNR_MAX;
+    return std::min(PSNR_MAX, 10 * log10(255.0 * 255.0 * w * h * 3 / se));
+}
+
+#ifndef HAVE_SDL
+/* without SDL its two software scaling modes are modelled: nearest picks the
+ * source pixel under the centre, linear interpolates the 2x2 around it */
+static void scale_nearest(const std::vector<uint32_t> &src, unsigned sw, unsigned sh, const resampler &r,
+                          uint32_t *dst)
+{
+    for (unsigned y = 0; y < r.h; ++y)
+        for (unsigned x = 0; x < r.w; ++x)
+            dst[(r.y0 + y) * r.dst_w + r.x0 + x] = src[(y * sh / r.h) * sw + x * sw / r.w];
+}
+
+static void scale_linear(const std::vector<uint32_t> &src, unsigned sw, unsigned sh, const resampler &r,
+                         uint32_t *dst)
+{
+    for (unsigned y = 0; y < r.h; ++y) {
+        const double fy = std::max(0.0, (y + 0.5) * sh / r.h - 0.5);
+        const unsigned y0 = unsigned(fy), y1 = std::min(y0 + 1, sh - 1);
+        const unsigned wy = unsigned((fy - y0) * 256);
+        for (unsigned x = 0; x < r.w; ++x) {
+            const double fx = std::max(0.0, (x + 0.5) * sw / r.w - 0.5);
+            const unsigned x0 = unsigned(fx), x1 = std::min(x0 + 1, sw - 1);
+            const unsigned wx = unsigned((fx - x0) * 256);
+            uint32_t out = 0;
+            for (unsigned c = 0; c < 32; c += 8) {
+                auto at = [&](unsigned yy, unsigned xx) {return src[yy * sw + xx] >> c & 0xff;};
+                const unsigned top = at(y0, x0) * (256 - wx) + at(y0, x1) * wx;
+                const unsigned bottom = at(y1, x0) * (256 - wx) + at(y1, x1) * wx;
+                out |= ((top * (256 - wy) + bottom * wy + (1 << 15)) >> 16) << c;
+            }
+            dst[(r.y0 + y) * r.dst_w + r.x0 + x] = out;
+        }
+    }
+}
+#endif
+
+/* s as a JSON string: quotes, backslashes and control characters escaped */
+static std::string json_string(const std::string &s)
+{
+    std::string out = "\"";
+    for (const char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char)c < 0x20) {
+            char esc[8];
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+            out += esc;
+        } else {
+            out += c;
+        }
+    }
+    return out + '"';
+}
+
+/* the screens of path, named after their files */
+static void load(const char *path, std::vector<screen> &screens)
+{
+    std::vector<std::vector<uint8_t> > data;
+    std::vector<std::string> names;
+    zx_load_screens(path, data, &names);
+    for (size_t i = 0; i < data.size(); ++i) {
+        screen s = {names[i], data[i]};
+        screens.push_back(s);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned iterations = 20, threads = 0, scale = 4, fit_w = 1920, fit_h = 1080;
+    const char *json = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:j:J:x:F:")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'x':
+            scale = atoi(optarg);
+            break;
+        case 'J':
+            json = optarg;
+            break;
+        case 'F':
+            if (sscanf(optarg, "%ux%u", &fit_w, &fit_h) != 2 || !fit_w || !fit_h)
+                fit_w = 0;
+            break;
+        default:
+            fprintf(stderr, "usage: scrbench [-n iterations] [-j threads] [-x 2|3|4] [-F WxH] [-J out.json] "
+                            "[dir|file.scr...]\n");
+            return -1;
+        }
+    }
+    if (!fit_w) {
+        fprintf(stderr, "-F takes the display size as WxH\n");
+        return -1;
+    }
+    // every stage runs at this scale factor
+    const zx_scaler *z = zx_scaler_for(scale);
+    if (!z) {
+        fprintf(stderr, "scale %u not supported\n", scale);
+        return -1;
+    }
+    const unsigned DST_W = SRC_W * scale, DST_H = SRC_H * scale;
+    std::vector<screen> screens;
+    if (optind >= argc)
+        load("screens", screens);
+    for (int i = optind; i < argc; ++i)
+        load(argv[i], screens);
+    if (screens.empty() || iterations == 0) {
+        fprintf(stderr, "no screens to run on\n");
+        return -1;
+    }
+    // opened first, so a bad path does not cost a whole run
+    FILE *out = json ? fopen(json, "w") : NULL;
+    if (json && !out) {
+        perror(json);
+        return -1;
+    }
+
+    color_init();
+    hqx_init();
+    thread_pool pool(threads), single(1);
+    tile_cache cache(2048, scale);
+    // the screen fitted into the display size, SDL scales the hqx frame there
+    const resampler fit(DST_W, DST_H, fit_w, fit_h);
+    std::vector<uint32_t> display(fit_w * fit_h);
+
+    std::vector<uint8_t> fb(SRC_W * SRC_H);
+    std::vector<YUV_pixel> yuv(DST_W * DST_H);
+    std::vector<uint32_t> argb(ZX_BORDER_W * scale * ZX_BORDER_H * scale);
+    // loading stripes over the lower half, a plain border above
+    uint8_t border[ZX_BORDER_H];
+    for (unsigned y = 0; y < ZX_BORDER_H; ++y)
+        border[y] = y < ZX_BORDER_H / 2 ? 1 : y / 3 % 8;
+
+#ifdef HAVE_SDL
+    SDL_Init(SDL_INIT_VIDEO);
+    SDL_Window *window = SDL_CreateWindow("scrbench", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, DST_W, DST_H, SDL_WINDOW_HIDDEN);
+    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, 0);
+    SDL_Texture *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, DST_W, DST_H);
+    // SDL's own stretching in its software renderer, into display[]
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormatFrom(display.data(), fit_w, fit_h, 32,
+                                                              fit_w * sizeof(uint32_t), SDL_PIXELFORMAT_ARGB8888);
+    SDL_Renderer *soft = SDL_CreateSoftwareRenderer(surface);
+    SDL_Texture *scaled[2];
+    const char *quality[2] = {"nearest", "linear"};
+    for (unsigned i = 0; i < 2; ++i) {
+        SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, quality[i]);
+        scaled[i] = SDL_CreateTexture(soft, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, DST_W, DST_H);
+    }
+    const SDL_Rect picture = {int(fit.x0), int(fit.y0), int(fit.w), int(fit.h)};
+    auto sdl_scale = [&](unsigned i) {
+        SDL_UpdateTexture(scaled[i], NULL, argb.data(), DST_W * sizeof(uint32_t));
+        SDL_RenderCopy(soft, scaled[i], NULL, &picture);
+    };
+#else
+    // without SDL the upload into a pitched texture buffer is all there is to time
+    std::vector<uint32_t> texture(DST_W * DST_H);
+#endif
+
+    // the stages before the one timed are run once to produce its input
+    std::vector<stage> stages = {
+        {"decode_ref", SRC_W * SRC_H, [&](const screen &s) {
+            for (unsigned y = 0; y < SRC_H; ++y)
+                for (unsigned x = 0; x < SRC_W; ++x)
+                    fb[y * SRC_W + x] = get_sinclair_color(s.data.data(), s.data.data() + SRC_H * MAXX, x, y);
+        }},
+        {"decode", SRC_W * SRC_H, [&](const screen &s) {
+            zx_decode(s.data.data(), s.data.data() + SRC_H * MAXX, fb.data());
+        }},
+        {"hqx_ref", DST_W * DST_H, [&](const screen &) {
+            z->filter_ref(fb.data(), yuv.data(), SRC_W, SRC_H);
+        }},
+        {"hqx_yuv", DST_W * DST_H, [&](const screen &) {
+            z->filter_yuv(fb.data(), yuv.data(), SRC_W, SRC_H);
+        }},
+        {"yuv2rgb_ref", DST_W * DST_H, [&](const screen &) {
+            for (unsigned i = 0; i < DST_W * DST_H; ++i) {
+                RGB_pixel rgb;
+                yuv2rgb(rgb, yuv[i]);
+                argb[i] = rgb2argb(rgb);
+            }
+        }},
+        {"yuv2rgb", DST_W * DST_H, [&](const screen &) {
+            yuv2argb(yuv.data(), argb.data(), DST_W * DST_H);
+        }},
+        {"hqx_argb", DST_W * DST_H, [&](const screen &) {
+            z->filter(fb.data(), argb.data(), SRC_W, SRC_H);
+        }},
+        {"hqx_argb_mt", DST_W * DST_H, [&](const screen &) {
+            z->filter_pool(pool, fb.data(), argb.data(), SRC_W, SRC_H);
+        }},
+        // all but the first iteration of a screen are served from the cache
+        {"tile_cache", DST_W * DST_H, [&](const screen &) {
+            cache.render(fb.data(), SRC_W, SRC_H, argb.data());
+        }},
+        {"fused", DST_W * DST_H, [&](const screen &s) {
+            z->hqx(s.data.data(), s.data.data() + SRC_H * MAXX, argb.data(), DST_W, 0, SRC_H, 0);
+        }},
+        {"fused_mt", DST_W * DST_H, [&](const screen &s) {
+            z->hqx_pool(pool, s.data.data(), s.data.data() + SRC_H * MAXX, argb.data(), DST_W, 0);
+        }},
+        {"border", ZX_BORDER_W * scale * ZX_BORDER_H * scale, [&](const screen &s) {
+            z->border_hqx(s.data.data(), s.data.data() + SRC_H * MAXX, border, argb.data(), ZX_BORDER_W * scale,
+                          0, ZX_BORDER_H, 0);
+        }},
+        {"border_mt", ZX_BORDER_W * scale * ZX_BORDER_H * scale, [&](const screen &s) {
+            z->border_hqx_pool(pool, s.data.data(), s.data.data() + SRC_H * MAXX, border, argb.data(),
+                               ZX_BORDER_W * scale, 0);
+        }},
+        // fused: the hqx filter is included, unlike in the scaling stages
+        {"fit", fit_w * fit_h, [&](const screen &s) {
+            z->fit(single, s.data.data(), s.data.data() + SRC_H * MAXX, NULL, true, fit, display.data(), fit_w, 0);
+        }},
+        {"fit_mt", fit_w * fit_h, [&](const screen &s) {
+            z->fit(pool, s.data.data(), s.data.data() + SRC_H * MAXX, NULL, true, fit, display.data(), fit_w, 0);
+        }},
+#ifdef HAVE_SDL
+        {"sdl_nearest", fit_w * fit_h, [&](const screen &) {sdl_scale(0);}},
+        {"sdl_linear", fit_w * fit_h, [&](const screen &) {sdl_scale(1);}},
+#else
+        {"nearest", fit_w * fit_h, [&](const screen &) {scale_nearest(argb, DST_W, DST_H, fit, display.data());}},
+        {"linear", fit_w * fit_h, [&](const screen &) {scale_linear(argb, DST_W, DST_H, fit, display.data());}},
+#endif
+        {"present", DST_W * DST_H, [&](const screen &) {
+#ifdef HAVE_SDL
+            SDL_UpdateTexture(texture, NULL, argb.data(), DST_W * sizeof(uint32_t));
+            SDL_RenderCopy(renderer, texture, NULL, NULL);
+            SDL_RenderPresent(renderer);
+#else
+            memcpy(texture.data(), argb.data(), DST_W * DST_H * sizeof(uint32_t));
+#endif
+        }},
+    };
+
+    // per stage, per screen
+    std::vector<std::vector<stats> > results(stages.size());
+    // PSNR of the fitted picture against Lanczos-3: resampler, nearest, linear
+    const char *const fit_names[3] = {"fit", "nearest", "linear"};
+    double fit_psnr[3] = {0, 0, 0};
+    std::vector<double> ref;
+    for (const screen &s : screens) {
+        zx_decode(s.data.data(), s.data.data() + SRC_H * MAXX, fb.data());
+        z->filter_yuv(fb.data(), yuv.data(), SRC_W, SRC_H);
+        z->filter(fb.data(), argb.data(), SRC_W, SRC_H);
+        for (size_t i = 0; i < stages.size(); ++i)
+            results[i].push_back(measure([&] {stages[i].run(s);}, iterations));
+        z->filter(fb.data(), argb.data(), SRC_W, SRC_H);
+        lanczos3(argb, DST_W, DST_H, fit.w, fit.h, ref);
+        for (unsigned i = 0; i < 3; ++i) {
+            if (i == 0)
+                z->fit(pool, s.data.data(), s.data.data() + SRC_H * MAXX, NULL, true, fit, display.data(), fit_w, 0);
+#ifdef HAVE_SDL
+            else
+                sdl_scale(i - 1);
+#else
+            else if (i == 1)
+                scale_nearest(argb, DST_W, DST_H, fit, display.data());
+            else
+                scale_linear(argb, DST_W, DST_H, fit, display.data());
+#endif
+            fit_psnr[i] += psnr(display.data(), fit_w, fit.x0, fit.y0, fit.w, fit.h, ref) / screens.size();
+        }
+    }
+
+    printf("%u screens, hq%ux, %u iterations, %u threads, %s kernels\n", unsigned(screens.size()), scale, iterations,
+           pool.size(), simd_level());
+    printf("%-12s %12s %10s %10s %12s %8s\n", "stage", "mean us", "stddev us", "ns/pixel", "frames/s", "cv %");
+    if (out)
+        fprintf(out, "{\n  \"scale\": %u,\n  \"iterations\": %u,\n  \"threads\": %u,\n  \"simd\": \"%s\",\n  \"stages\": [\n",
+                scale, iterations, pool.size(), simd_level());
+    for (size_t i = 0; i < stages.size(); ++i) {
+        // frame time variance over all screens and iterations
+        double mean = 0, var = 0;
+        for (const stats &r : results[i])
+            mean += r.mean;
+        mean /= screens.size();
+        for (const stats &r : results[i])
+            var += r.stddev * r.stddev + (r.mean - mean) * (r.mean - mean);
+        double stddev = sqrt(var / screens.size());
+        printf("%-12s %12.1f %10.1f %10.3f %12.1f %8.1f\n", stages[i].name, mean / 1000, stddev / 1000,
+               mean / stages[i].pixels, 1e9 / mean, 100 * stddev / mean);
+        if (!out)
+            continue;
+        fprintf(out, "    {\"name\": \"%s\", \"pixels\": %u, \"mean_ns\": %.0f, \"stddev_ns\": %.0f, "
+                     "\"ns_per_pixel\": %.4f, \"fps\": %.2f, \"screens\": {",
+                stages[i].name, stages[i].pixels, mean, stddev, mean / stages[i].pixels, 1e9 / mean);
+        for (size_t j = 0; j < screens.size(); ++j)
+            fprintf(out, "%s%s: {\"mean_ns\": %.0f, \"stddev_ns\": %.0f, \"min_ns\": %.0f}", j ? ", " : "",
+                    json_string(screens[j].name).c_str(), results[i][j].mean, results[i][j].stddev, results[i][j].min);
+        fprintf(out, "}}%s\n", i + 1 < stages.size() ? "," : "");
+    }
+    printf("fit %ux%u into %ux%u, %u/%u taps, PSNR against Lanczos-3:", fit.w, fit.h, fit_w, fit_h, fit.taps_x,
+           fit.taps_y);
+    for (unsigned i = 0; i < 3; ++i)
+        printf(" %s %.2f dB", fit_names[i], fit_psnr[i]);
+    printf("\n");
+    printf("tile cache: %llu hits, %llu misses\n", (unsigned long long)cache.hits, (unsigned long long)cache.misses);
+    int status = 0;
+    if (out) {
+        fprintf(out, "  ],\n  \"fit\": {\"width\": %u, \"height\": %u, \"picture\": [%u, %u, %u, %u], \"psnr_db\": {",
+                fit_w, fit_h, fit.x0, fit.y0, fit.w, fit.h);
+        for (unsigned i = 0; i < 3; ++i)
+            fprintf(out, "%s\"%s\": %.3f", i ? ", " : "", fit_names[i], fit_psnr[i]);
+        fprintf(out, "}}\n}\n");
+        const bool failed = ferror(out);
+        if (fclose(out) != 0 || failed) {
+            perror(json);
+            status = 1;
+        }
+    }
+#ifdef HAVE_SDL
+    SDL_Quit();
+#endif
+    return status;
+}
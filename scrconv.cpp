@@ -0,0 +1,129 @@
+/* Headless batch converter: decodes and hqx upscales (4x by default) the
+ * screens of .scr, .sna, .z80 and .tap files in parallel and writes them as
+ * PNG or PPM images. */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "colors.h"
+#include "hqx.h"
+#include "image.h"
+#include "pipeline.h"
+#include "snapshot.h"
+#include "thread_pool.h"
+#include "zxscreen.h"
+
+static void usage()
+{
+    fprintf(stderr, "usage: scrconv [-j threads] [-x 2|3|4] [-f png|ppm] [-o outdir] file.scr|sna|z80|tap|dir...\n");
+    exit(-1);
+}
+
+/* buf is the image buffer, reused for every screen a thread converts */
+static bool convert(const std::string &in, const std::string &out, bool png, const zx_scaler &z,
+                    std::vector<uint32_t> &buf)
+{
+    uint8_t scr[ZX_SCREEN_SIZE];
+    if (!zx_load_screen(in.c_str(), scr))
+        return false;
+    const unsigned w = MAXX*8 * z.scale, h = MAXY*8 * z.scale;
+    buf.resize(w * h);
+    z.hqx(scr, scr + MAXY*8 * MAXX, buf.data(), w, 0, MAXY*8, 0);
+    if (png)
+        return write_png(out.c_str(), buf.data(), w, h);
+    return write_ppm(out.c_str(), buf.data(), w, h);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned threads = 0, scale = 4;
+    bool png = true;
+    std::string outdir = ".";
+    int opt;
+    while ((opt = getopt(argc, argv, "j:x:f:o:")) != -1) {
+        switch (opt) {
+        case 'j': {
+            // 0 is one thread per core, a sign would wrap around
+            char *end;
+            const unsigned long n = strtoul(optarg, &end, 10);
+            if (!isdigit((unsigned char)*optarg) || *end || n > 1024)
+                usage();
+            threads = n;
+            break;
+        }
+        case 'x':
+            scale = atoi(optarg);
+            break;
+        case 'f':
+            if (strcmp(optarg, "png") && strcmp(optarg, "ppm"))
+                usage();
+            png = strcmp(optarg, "png") == 0;
+            break;
+        case 'o':
+            outdir = optarg;
+            break;
+        default:
+            usage();
+        }
+    }
+    const zx_scaler *z = zx_scaler_for(scale);
+    if (optind >= argc || !z)
+        usage();
+
+    // inputs that cannot be read fail the run like screens that do not convert
+    std::vector<std::string> files;
+    unsigned unreadable = 0;
+    for (int i = optind; i < argc; ++i)
+        if (!zx_screen_files(argv[i], files))
+            ++unreadable;
+
+    // outputs are named after the inputs without their directory and
+    // extension, two inputs writing the same file would race
+    std::vector<std::string> outs;
+    std::map<std::string, unsigned> first;
+    unsigned clashes = 0;
+    for (const std::string &in : files) {
+        std::string base = in.substr(in.rfind('/') + 1);
+        if (zx_screen_file(base.c_str()))
+            base.resize(base.rfind('.'));
+        outs.push_back(outdir + "/" + base + (png ? ".png" : ".ppm"));
+        auto seen = first.insert(std::make_pair(outs.back(), unsigned(outs.size() - 1)));
+        if (!seen.second) {
+            fprintf(stderr, "%s and %s would both be written to %s\n", files[seen.first->second].c_str(),
+                    in.c_str(), outs.back().c_str());
+            ++clashes;
+        }
+    }
+    if (clashes)
+        return -1;
+
+    color_init();
+    hqx_init();
+    thread_pool pool(threads);
+
+    std::atomic<unsigned> failed(unreadable);
+    auto start = std::chrono::steady_clock::now();
+    pool.run(files.size(), [&](unsigned i) {
+        static thread_local std::vector<uint32_t> buf;
+        const std::string &in = files[i];
+        if (!convert(in, outs[i], png, *z, buf)) {
+            fprintf(stderr, "%s: conversion failed\n", in.c_str());
+            ++failed;
+        }
+    });
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    unsigned done = files.size() + unreadable - failed;
+    printf("%u screens in %.3f s, %.1f screens/s on %u threads\n", done, secs, secs > 0 ? done / secs : 0.0, pool.size());
+    return failed ? 1 : 0;
+}
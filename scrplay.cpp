@@ -0,0 +1,92 @@
+/* Frame producer for the viewer's live mode: replays the screens of .scr,
+ * .sna, .z80 and .tap files into the shared memory frame ring at 50 Hz, the
+ * way an emulator would. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "frame_ring.h"
+#include "snapshot.h"
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int)
+{
+    stop = 1;
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: scrplay [-r ring] [-f fps] [-s frames per screen] [-n frames]\n"
+                    "               file.scr|sna|z80|tap|dir...\n");
+    exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *name = FRAME_RING_NAME;
+    unsigned fps = 50, hold = 1;
+    unsigned long long frames = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:f:s:n:")) != -1) {
+        switch (opt) {
+        case 'r':
+            name = optarg;
+            break;
+        case 'f':
+            fps = atoi(optarg);
+            break;
+        case 's':
+            hold = atoi(optarg);
+            break;
+        case 'n':
+            frames = strtoull(optarg, NULL, 10);
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind >= argc || fps == 0 || hold == 0)
+        usage();
+    std::vector<std::vector<uint8_t> > screens;
+    for (int i = optind; i < argc; ++i)
+        zx_load_screens(argv[i], screens);
+    if (screens.empty())
+        usage();
+
+    frame_ring *ring = frame_ring::create(name);
+    if (!ring) {
+        perror(name);
+        return -1;
+    }
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    printf("playing %u screens into %s at %u Hz\n", unsigned(screens.size()), name, fps);
+
+    // frames are due at absolute times, so a late one does not delay the rest
+    timespec due;
+    clock_gettime(CLOCK_MONOTONIC, &due);
+    for (unsigned long long n = 0; !stop && (frames == 0 || n < frames); ++n) {
+        const unsigned screen = n / hold % screens.size();
+        zx_frame *frame = ring->write_slot();
+        memcpy(frame, screens[screen].data(), ZX_SCREEN_SIZE);
+        memset(frame->border, screen % 8, sizeof(frame->border));
+        ring->publish();
+        due.tv_nsec += 1000000000 / fps;
+        if (due.tv_nsec >= 1000000000) {
+            due.tv_nsec -= 1000000000;
+            ++due.tv_sec;
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR && !stop)
+            ;
+    }
+    delete ring;
+    return 0;
+}
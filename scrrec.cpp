@@ -0,0 +1,212 @@
+/* Records hqx upscaled frames (4x by default) as a YUV4MPEG2 stream for
+ * external encoders, from .scr, .sna, .z80 and .tap files or live from the
+ * frame ring, e.g.
+ *     scrrec -n 500 screens | ffmpeg -i - out.mkv
+ * or, with -t, as a tile delta stream for remote displays and tileplay. */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <vector>
+
+#include "colors.h"
+#include "frame_ring.h"
+#include "hqx.h"
+#include "pipeline.h"
+#include "snapshot.h"
+#include "thread_pool.h"
+#include "tile_stream.h"
+#include "y4m.h"
+#include "zxscreen.h"
+
+const unsigned SRC_W = MAXX*8, SRC_H = MAXY*8;
+
+static volatile sig_atomic_t stop;
+static frame_ring *ring;
+
+static void on_signal(int)
+{
+    stop = 1;
+    // a live recording waiting for its next frame
+    if (ring)
+        ring->wake();
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: scrrec [-o out.y4m] [-c 444|420] [-f fps] [-s frames per screen] [-n frames] [-j threads]\n"
+                    "              [-x 2|3|4] [-t [-k key interval]] -r ring | file.scr|sna|z80|tap|dir...\n");
+    exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *out_path = "-", *ring_name = NULL;
+    bool subsample = false, tiles = false;
+    unsigned fps = 50, hold = 50, threads = 1, key_interval = 0, scale = 4;
+    unsigned long long frames = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "o:c:f:s:n:j:x:r:tk:")) != -1) {
+        switch (opt) {
+        case 'o':
+            out_path = optarg;
+            break;
+        case 'c':
+            if (strcmp(optarg, "444") && strcmp(optarg, "420"))
+                usage();
+            subsample = strcmp(optarg, "420") == 0;
+            break;
+        case 'f':
+            fps = atoi(optarg);
+            break;
+        case 's':
+            hold = atoi(optarg);
+            break;
+        case 'n':
+            frames = strtoull(optarg, NULL, 10);
+            break;
+        case 'j': {
+            // 0 is one thread per core, a sign would wrap around
+            char *end;
+            const unsigned long n = strtoul(optarg, &end, 10);
+            if (!isdigit((unsigned char)*optarg) || *end || n > 1024)
+                usage();
+            threads = n;
+            break;
+        }
+        case 'x':
+            scale = atoi(optarg);
+            break;
+        case 'r':
+            ring_name = optarg;
+            break;
+        case 't':
+            tiles = true;
+            break;
+        case 'k':
+            key_interval = atoi(optarg);
+            break;
+        default:
+            usage();
+        }
+    }
+    const zx_scaler *z = zx_scaler_for(scale);
+    if (fps == 0 || hold == 0 || !z || (!ring_name && optind >= argc))
+        usage();
+    const unsigned dst_w = SRC_W * scale, dst_h = SRC_H * scale;
+
+    std::vector<std::vector<uint8_t> > screens;
+    for (int i = optind; i < argc; ++i)
+        zx_load_screens(argv[i], screens);
+    if (ring_name) {
+        ring = frame_ring::open(ring_name);
+        if (!ring) {
+            perror(ring_name);
+            return -1;
+        }
+    } else if (screens.empty()) {
+        usage();
+    } else if (frames == 0) {
+        frames = screens.size() * hold;
+    }
+
+    int fd = strcmp(out_path, "-") ? open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644) : 1;
+    if (fd == -1) {
+        perror(out_path);
+        return -1;
+    }
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    color_init();
+    hqx_init();
+    thread_pool pool(threads);
+    y4m_writer y4m(fd, dst_w, dst_h, fps, subsample);
+    tile_encoder delta(fd, dst_w, dst_h, fps);
+    std::vector<uint8_t> fb(SRC_W * SRC_H);
+    std::vector<YUV_pixel> yuv;
+    std::vector<uint32_t> argb;
+    if (tiles)
+        argb.resize(dst_w * dst_h);
+    else
+        yuv.resize(dst_w * dst_h);
+    double encode_secs = 0;
+    // the last frame again, a screen held or a live frame dropped
+    auto repeat = [&](unsigned long long n) {
+        const bool key = key_interval && n % key_interval == 0;
+        if (!tiles)
+            return y4m.repeat();
+        auto encode_start = std::chrono::steady_clock::now();
+        const bool ok = delta.repeat(key);
+        encode_secs += std::chrono::duration<double>(std::chrono::steady_clock::now() - encode_start).count();
+        return ok;
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    unsigned long long n = 0;
+    bool ok = true;
+    for (; ok && !stop && (frames == 0 || n < frames); ++n) {
+        const uint8_t *scr;
+        if (ring) {
+            const uint64_t last = ring->frame_number();
+            const zx_frame *frame;
+            while (!(frame = ring->take()) && !stop)
+                ring->wait();
+            if (!frame)
+                break;
+            // frames published since the last one taken were dropped, the
+            // last one is repeated in their place to keep the stream's rate
+            if (last)
+                for (uint64_t k = ring->frame_number() - last; ok && --k && (frames == 0 || n < frames); ++n)
+                    ok = repeat(n);
+            if (!ok || (frames && n == frames))
+                break;
+            scr = &frame->pix[0][0];
+        } else if (n % hold == 0) {
+            scr = screens[n / hold % screens.size()].data();
+        } else {
+            // a screen held for several frames is upscaled once
+            ok = repeat(n);
+            continue;
+        }
+        // -k: all tiles every key_interval frames, so a display can join late
+        const bool key = key_interval && n % key_interval == 0;
+        zx_decode(scr, scr + SRC_H * MAXX, fb.data());
+        if (tiles) {
+            z->filter_pool(pool, fb.data(), argb.data(), SRC_W, SRC_H);
+            auto encode_start = std::chrono::steady_clock::now();
+            ok = delta.write(argb.data(), key);
+            encode_secs += std::chrono::duration<double>(std::chrono::steady_clock::now() - encode_start).count();
+        } else {
+            z->filter_yuv_pool(pool, fb.data(), yuv.data(), SRC_W, SRC_H);
+            ok = y4m.write(yuv.data());
+        }
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!ok)
+        perror(out_path);
+    fprintf(stderr, "%llu frames in %.3f s, %.1f frames/s%s\n", n, secs, secs > 0 ? n / secs : 0.0,
+            ring ? "" : " (offline)");
+    if (tiles && delta.frames) {
+        const double raw = double(delta.frames) * dst_w * dst_h * sizeof(uint32_t);
+        fprintf(stderr, "tile stream: %llu bytes, %.2f%% of raw, %.1f tiles/frame (%llu fill, %llu packed, "
+                        "%llu runs, %llu raw), encoding %.3f ms/frame\n",
+                (unsigned long long)delta.bytes, 100.0 * delta.bytes / raw, double(delta.tiles) / delta.frames,
+                (unsigned long long)delta.coded[TILE_FILL], (unsigned long long)delta.coded[TILE_PACKED],
+                (unsigned long long)delta.coded[TILE_RUNS], (unsigned long long)delta.coded[TILE_RAW],
+                encode_secs * 1000 / delta.frames);
+    }
+    if (ring)
+        fprintf(stderr, "frames dropped: %llu\n", (unsigned long long)ring->dropped);
+    if (fd != 1)
+        close(fd);
+    delete ring;
+    return ok ? 0 : 1;
+}
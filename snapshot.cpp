@@ -0,0 +1,245 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "snapshot.h"
+
+namespace {
+
+const unsigned BANK_SIZE = 16384;
+
+inline unsigned word(const uint8_t *p)
+{
+    return p[0] | p[1] << 8;
+}
+
+/* .z80 run length coding: ED ED n b is n times b, everything else is
+ * literal. Stops once len bytes are out, false if src ends before. */
+bool unrle(const uint8_t *src, size_t n, uint8_t *out, size_t len)
+{
+    size_t o = 0;
+    for (size_t i = 0; i < n && o < len;) {
+        if (i + 4 <= n && src[i] == 0xed && src[i + 1] == 0xed) {
+            for (unsigned count = src[i + 2]; count && o < len; --count)
+                out[o++] = src[i + 3];
+            i += 4;
+        } else {
+            out[o++] = src[i++];
+        }
+    }
+    return o == len;
+}
+
+/* 27 byte header and the 48K from 0x4000, 128K ones go on with the 0x7ffd
+ * port value and the banks not paged in, in ascending order */
+bool sna_screen(const uint8_t *f, size_t size, uint8_t *scr, uint8_t *border)
+{
+    const size_t HEADER = 27, RAM48 = HEADER + 3 * BANK_SIZE;
+    if (size < HEADER + ZX_SCREEN_SIZE)
+        return false;
+    const uint8_t *screen = f + HEADER;  // bank 5
+    if (size >= RAM48 + 4 + 5 * BANK_SIZE && (f[RAM48 + 2] & 0b1000)) {
+        // the shadow screen in bank 7, at 0xc000 if paged in
+        const unsigned paged = f[RAM48 + 2] & 0b111;
+        if (paged == 7) {
+            screen = f + HEADER + 2 * BANK_SIZE;
+        } else {
+            unsigned index = 0;
+            for (unsigned bank = 0; bank < 7; ++bank)
+                index += bank != 2 && bank != 5 && bank != paged;
+            screen = f + RAM48 + 4 + index * BANK_SIZE;
+            if (screen + ZX_SCREEN_SIZE > f + size)
+                return false;
+        }
+    }
+    memcpy(scr, screen, ZX_SCREEN_SIZE);
+    if (border)
+        *border = f[26] & 0b111;
+    return true;
+}
+
+/* Version 1 has a 30 byte header and the 48K from 0x4000, compressed if bit
+ * 5 of byte 12 is set. Later versions (PC 0) have a longer header and the
+ * memory in blocks of a 16K page each: length (0xffff if stored), page
+ * number, data. The screen is page 8 (bank 5), or 10 (bank 7) when a 128K
+ * machine shows the shadow screen. */
+bool z80_screen(const uint8_t *f, size_t size, uint8_t *scr, uint8_t *border)
+{
+    if (size < 32)
+        return false;
+    const uint8_t flags = f[12] == 0xff ? 1 : f[12];
+    if (border)
+        *border = flags >> 1 & 0b111;
+    if (word(f + 6)) {
+        if (!(flags & 0b100000)) {
+            if (size < 30 + ZX_SCREEN_SIZE)
+                return false;
+            memcpy(scr, f + 30, ZX_SCREEN_SIZE);
+            return true;
+        }
+        return unrle(f + 30, size - 30, scr, ZX_SCREEN_SIZE);
+    }
+    const size_t extra = word(f + 30);
+    const unsigned mode = size > 34 ? f[34] : 0;
+    const bool is128 = extra == 23 ? mode == 3 || mode == 4
+                                   : mode >= 4 && mode <= 13 && mode != 11;
+    const unsigned page = is128 && size > 35 && (f[35] & 0b1000) ? 10 : 8;
+    for (size_t pos = 32 + extra; pos + 3 <= size;) {
+        const unsigned len = word(f + pos);
+        const bool stored = len == 0xffff;
+        const size_t bytes = stored ? BANK_SIZE : len;
+        const uint8_t *data = f + pos + 3;
+        if (pos + 3 + bytes > size)
+            return false;
+        if (f[pos + 2] == page) {
+            if (!stored)
+                return unrle(data, bytes, scr, ZX_SCREEN_SIZE);
+            memcpy(scr, data, ZX_SCREEN_SIZE);
+            return true;
+        }
+        // any other page is skipped without looking at it
+        pos += 3 + bytes;
+    }
+    return false;
+}
+
+/* Blocks of a length word, a flag byte (0 header, 0xff data), the payload
+ * and a checksum. SCREEN$ is saved as a CODE header (type 3) of 6912 bytes
+ * at 16384 followed by its data block; a headerless 6912 byte data block is
+ * taken if the tape has no such header. */
+bool tap_screen(const uint8_t *f, size_t size, uint8_t *scr)
+{
+    const uint8_t *headerless = NULL;
+    bool screen_header = false;
+    for (size_t pos = 0; pos + 2 <= size;) {
+        const unsigned len = word(f + pos);
+        const uint8_t *block = f + pos + 2;
+        if (pos + 2 + len > size)
+            break;
+        if (len == 19 && block[0] == 0x00) {
+            screen_header = block[1] == 3 && word(block + 12) == ZX_SCREEN_SIZE && word(block + 14) == 16384;
+        } else {
+            if (len == ZX_SCREEN_SIZE + 2 && block[0] == 0xff) {
+                if (screen_header) {
+                    memcpy(scr, block + 1, ZX_SCREEN_SIZE);
+                    return true;
+                }
+                if (!headerless)
+                    headerless = block + 1;
+            }
+            screen_header = false;
+        }
+        pos += 2 + len;
+    }
+    if (!headerless)
+        return false;
+    memcpy(scr, headerless, ZX_SCREEN_SIZE);
+    return true;
+}
+
+const char *extension(const char *name)
+{
+    const char *dot = strrchr(name, '.');
+    return dot ? dot : "";
+}
+
+}
+
+bool zx_screen_file(const char *name)
+{
+    const char *ext = extension(name);
+    return !strcasecmp(ext, ".scr") || !strcasecmp(ext, ".sna") || !strcasecmp(ext, ".z80") ||
+           !strcasecmp(ext, ".tap");
+}
+
+bool zx_load_screen(const char *path, uint8_t *scr, uint8_t *border)
+{
+    const int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    const size_t size = st.st_size;
+    if (size == 0) {
+        close(fd);
+        errno = EINVAL;
+        return false;
+    }
+    // only the pages touched are read in
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+    const uint8_t *f = static_cast<const uint8_t *>(map);
+    const char *ext = extension(path);
+    bool ok;
+    if (!strcasecmp(ext, ".sna"))
+        ok = sna_screen(f, size, scr, border);
+    else if (!strcasecmp(ext, ".z80"))
+        ok = z80_screen(f, size, scr, border);
+    else if (!strcasecmp(ext, ".tap"))
+        ok = tap_screen(f, size, scr);
+    else if ((ok = size >= ZX_SCREEN_SIZE))
+        memcpy(scr, f, ZX_SCREEN_SIZE);
+    munmap(map, size);
+    if (!ok)
+        errno = EINVAL;
+    return ok;
+}
+
+bool zx_screen_files(const char *path, std::vector<std::string> &files)
+{
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        perror(path);
+        return false;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        files.push_back(path);
+        return true;
+    }
+    DIR *dir = opendir(path);
+    if (!dir) {
+        perror(path);
+        return false;
+    }
+    std::vector<std::string> found;
+    while (struct dirent *e = readdir(dir))
+        if (zx_screen_file(e->d_name))
+            found.push_back(std::string(path) + "/" + e->d_name);
+    closedir(dir);
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+    return true;
+}
+
+bool zx_load_screens(const char *path, std::vector<std::vector<uint8_t> > &screens,
+                     std::vector<std::string> *names)
+{
+    std::vector<std::string> files;
+    if (!zx_screen_files(path, files))
+        return false;
+    for (const std::string &file : files) {
+        std::vector<uint8_t> scr(ZX_SCREEN_SIZE);
+        if (!zx_load_screen(file.c_str(), scr.data())) {
+            fprintf(stderr, "%s: not a screen\n", file.c_str());
+            continue;
+        }
+        screens.push_back(scr);
+        if (names)
+            names->push_back(file.substr(file.rfind('/') + 1));
+    }
+    return true;
+}
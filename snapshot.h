@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+/* Screens of Spectrum files: raw .scr dumps, .sna and .z80 snapshots and
+ * .tap tapes, told apart by their extension. The file is mapped and only the
+ * 6912 bytes at 0x4000 are extracted: of a .z80 only the memory block holding
+ * the screen is decompressed and only as far as the screen reaches, a tape
+ * is searched for its SCREEN$ block. */
+
+const unsigned ZX_SCREEN_SIZE = 6912;
+
+/* true if name has one of the extensions above */
+bool zx_screen_file(const char *name);
+
+/* the screen of the file at path into scr (in .scr layout), false with errno
+ * set if it cannot be read or holds no screen. Snapshots also set *border
+ * to the border colour they were taken with, other files leave it alone. */
+bool zx_load_screen(const char *path, uint8_t *scr, uint8_t *border = NULL);
+
+/* path itself, or the screen files of the directory path in name order,
+ * appended to files; false (reported on stderr) if path cannot be read */
+bool zx_screen_files(const char *path, std::vector<std::string> &files);
+
+/* the screens of zx_screen_files(path) appended to screens and, if names is
+ * not NULL, their file names without the directory; files holding no screen
+ * are reported on stderr and skipped */
+bool zx_load_screens(const char *path, std::vector<std::vector<uint8_t> > &screens,
+                     std::vector<std::string> *names = NULL);
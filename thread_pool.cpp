@@ -0,0 +1,56 @@
+#include "thread_pool.h"
+
+thread_pool::thread_pool(unsigned threads) : job(nullptr), total(0), next(0), finished(0), quit(false)
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    for (unsigned i = 1; i < threads; ++i)
+        workers.emplace_back(&thread_pool::work, this);
+}
+
+thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        quit = true;
+    }
+    wake.notify_all();
+    for (auto &t : workers)
+        t.join();
+}
+
+void thread_pool::run(unsigned tasks, const std::function<void(unsigned)> &fn)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    job = &fn;
+    total = tasks;
+    next = 0;
+    finished = 0;
+    wake.notify_all();
+    while (next < total) {
+        unsigned i = next++;
+        guard.unlock();
+        fn(i);
+        guard.lock();
+        ++finished;
+    }
+    done.wait(guard, [this] {return finished == total;});
+    job = nullptr;
+}
+
+void thread_pool::work()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;) {
+        wake.wait(guard, [this] {return quit || (job && next < total);});
+        if (quit)
+            return;
+        unsigned i = next++;
+        const std::function<void(unsigned)> *fn = job;
+        guard.unlock();
+        (*fn)(i);
+        guard.lock();
+        if (++finished == total)
+            done.notify_one();
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Fixed set of worker threads created once and reused for every job. */
+class thread_pool {
+public:
+    /* threads counts the calling thread too, 0 picks the number of cores */
+    explicit thread_pool(unsigned threads = 0);
+    ~thread_pool();
+
+    unsigned size() const {return workers.size() + 1;}
+
+    /* calls fn(0) .. fn(tasks - 1) on the workers and the calling thread,
+     * returns once all of them are done */
+    void run(unsigned tasks, const std::function<void(unsigned)> &fn);
+
+private:
+    void work();
+
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(unsigned)> *job;
+    unsigned total;
+    unsigned next;
+    unsigned finished;
+    bool quit;
+};
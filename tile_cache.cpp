@@ -0,0 +1,86 @@
+#include <string.h>
+
+#include "hqx.h"
+#include "tile_cache.h"
+
+tile_cache::tile_cache(unsigned n, unsigned scale) : hits(0), misses(0), scale(scale), tile(8 * scale * 8 * scale)
+{
+    if (scale == 2)
+        filter_rect = hqx_filter_rect<2>;
+    else if (scale == 3)
+        filter_rect = hqx_filter_rect<3>;
+    else
+        filter_rect = hqx_filter_rect<4>;
+    buckets = 1;
+    while (buckets * WAYS < n)
+        buckets <<= 1;
+    slots.resize(buckets * WAYS);
+    tiles.resize(buckets * WAYS * tile);
+    victim.resize(buckets);
+}
+
+static uint64_t hash_key(const uint8_t *key, unsigned len)
+{
+    uint64_t h = 0x9e3779b97f4a7c15ull;
+    for (unsigned i = 0; i < len; i += 8) {
+        uint64_t v = 0;
+        memcpy(&v, key + i, len - i < 8 ? len - i : 8);
+        h = (h ^ v) * 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+void tile_cache::render_cell(const uint8_t *src, unsigned width, unsigned height, unsigned xb, unsigned yb,
+                             uint32_t *dst, unsigned pitch)
+{
+    // the cell and its ring, clamped at the frame edges like hqx_filter does
+    uint8_t key[KEY];
+    for (unsigned j = 0; j < 10; ++j) {
+        int y = int(yb * 8 + j) - 1;
+        y = y < 0 ? 0 : y >= int(height) ? height - 1 : y;
+        for (unsigned i = 0; i < 10; ++i) {
+            int x = int(xb * 8 + i) - 1;
+            x = x < 0 ? 0 : x >= int(width) ? width - 1 : x;
+            key[j * 10 + i] = src[y * width + x];
+        }
+    }
+    const uint64_t h = hash_key(key, KEY);
+    const unsigned bucket = h & (buckets - 1);
+    unsigned way = 0;
+    for (; way < WAYS; ++way) {
+        const slot &s = slots[bucket * WAYS + way];
+        if (s.used && s.hash == h && memcmp(s.key, key, KEY) == 0)
+            break;
+    }
+    const unsigned side = 8 * scale;
+    uint32_t *cached;
+    if (way < WAYS) {
+        ++hits;
+        cached = &tiles[(bucket * WAYS + way) * tile];
+    } else {
+        ++misses;
+        way = victim[bucket];
+        victim[bucket] = (way + 1) % WAYS;
+        slot &s = slots[bucket * WAYS + way];
+        s.hash = h;
+        s.used = true;
+        memcpy(s.key, key, KEY);
+        // the key is a 10x10 image whose inner 8x8 sees exactly the cell's neighbourhood
+        uint32_t out[40 * 40];
+        filter_rect(key, out, 10, 10, 1, 1, 9, 9);
+        cached = &tiles[(bucket * WAYS + way) * tile];
+        for (unsigned j = 0; j < side; ++j)
+            memcpy(cached + j * side, out + (j + scale) * 10 * scale + scale, side * sizeof(uint32_t));
+    }
+    for (unsigned j = 0; j < side; ++j)
+        memcpy(dst + j * pitch, cached + j * side, side * sizeof(uint32_t));
+}
+
+void tile_cache::render(const uint8_t *src, unsigned width, unsigned height, uint32_t *dst)
+{
+    for (unsigned yb = 0; yb < height / 8; ++yb)
+        for (unsigned xb = 0; xb < width / 8; ++xb)
+            render_cell(src, width, height, xb, yb, dst + yb * 8 * scale * width * scale + xb * 8 * scale,
+                        width * scale);
+}
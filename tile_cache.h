@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+/* hqx output of 8x8 cells cached by content. The key of a cell is its 10x10
+ * palette indices including the 1 pixel ring around it, which is everything
+ * its upscaled tile (32x32 at 4x) depends on, so repeated cells (blank
+ * background, font glyphs, game tiles) are rendered once and then copied. */
+class tile_cache {
+public:
+    /* slots is rounded up to a multiple of the associativity, scale is the
+     * hqx factor 2, 3 or 4 */
+    explicit tile_cache(unsigned slots = 2048, unsigned scale = 4);
+
+    /* the cell (xb, yb) of the width x height indexed src into dst (pitch in
+     * pixels, pointing at the tile's top left output pixel) */
+    void render_cell(const uint8_t *src, unsigned width, unsigned height, unsigned xb, unsigned yb,
+                     uint32_t *dst, unsigned pitch);
+
+    /* all cells, width and height are multiples of 8, dst is scale times the source */
+    void render(const uint8_t *src, unsigned width, unsigned height, uint32_t *dst);
+
+    uint64_t hits;
+    uint64_t misses;
+
+private:
+    static const unsigned WAYS = 4;
+    static const unsigned KEY = 10 * 10;
+
+    struct slot {
+        uint64_t hash;
+        bool used;
+        uint8_t key[KEY];
+    };
+
+    std::vector<slot> slots;
+    std::vector<uint32_t> tiles;
+    std::vector<uint8_t> victim;   // next way to replace per bucket
+    unsigned buckets;
+    unsigned scale;
+    unsigned tile;  // pixels per tile
+    void (*filter_rect)(const uint8_t *, uint32_t *, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned);
+};
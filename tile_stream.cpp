@@ -0,0 +1,316 @@
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "tile_stream.h"
+
+namespace {
+
+const char MAGIC[4] = {'Z', 'X', 'T', '1'};
+const unsigned HEADER_SIZE = 10;
+const unsigned TABLE_SIZE = 512; // twice the largest palette
+
+inline void put16(std::vector<uint8_t> &out, unsigned v)
+{
+    out.push_back(v);
+    out.push_back(v >> 8);
+}
+
+inline void put32(std::vector<uint8_t> &out, uint32_t v)
+{
+    put16(out, v);
+    put16(out, v >> 16);
+}
+
+inline unsigned get16(const uint8_t *p)
+{
+    return p[0] | p[1] << 8;
+}
+
+inline uint32_t get32(const uint8_t *p)
+{
+    return get16(p) | uint32_t(get16(p + 2)) << 16;
+}
+
+/* bits per packed index for n colours */
+inline unsigned index_bits(unsigned n)
+{
+    return n <= 2 ? 1 : n <= 4 ? 2 : n <= 16 ? 4 : 8;
+}
+
+bool write_all(int fd, const uint8_t *p, size_t n)
+{
+    while (n) {
+        const ssize_t done = ::write(fd, p, n);
+        if (done < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        p += done;
+        n -= done;
+    }
+    return true;
+}
+
+}
+
+const unsigned tile_encoder::TILE;
+
+tile_encoder::tile_encoder(int f, unsigned w, unsigned h, unsigned r)
+    : frames(0), tiles(0), bytes(0), fd(f), width(w), height(h), fps(r),
+      columns((w + TILE - 1) / TILE), rows((h + TILE - 1) / TILE), started(false), prev(w * h),
+      table(TABLE_SIZE), stamp(0)
+{
+    std::fill(coded, coded + TILE_RAW + 1, 0);
+    for (slot &s : table)
+        s.stamp = 0;
+}
+
+bool tile_encoder::write(const uint32_t *frame, bool key)
+{
+    out.clear();
+    if (!started) {
+        for (char c : MAGIC)
+            out.push_back(c);
+        put16(out, width);
+        put16(out, height);
+        out.push_back(TILE);
+        out.push_back(fps);
+        started = true;
+        key = true;
+    }
+    const size_t start = out.size();
+    put32(out, 0);
+    put16(out, 0);
+    unsigned n = 0;
+    for (unsigned ty = 0; ty < rows; ++ty) {
+        for (unsigned tx = 0; tx < columns; ++tx) {
+            const unsigned x0 = tx * TILE, y0 = ty * TILE;
+            const unsigned w = std::min(TILE, width - x0), h = std::min(TILE, height - y0);
+            bool changed = key;
+            for (unsigned y = y0; y < y0 + h && !changed; ++y)
+                changed = memcmp(frame + y * width + x0, &prev[y * width + x0], w * sizeof(uint32_t)) != 0;
+            if (!changed)
+                continue;
+            encode(frame, tx, ty);
+            ++n;
+            // repeat() codes prev against itself
+            if (frame != prev.data())
+                for (unsigned y = y0; y < y0 + h; ++y)
+                    memcpy(&prev[y * width + x0], frame + y * width + x0, w * sizeof(uint32_t));
+        }
+    }
+    const uint32_t len = out.size() - start - 4;
+    for (unsigned i = 0; i < 4; ++i)
+        out[start + i] = len >> (8 * i);
+    out[start + 4] = n;
+    out[start + 5] = n >> 8;
+    ++frames;
+    tiles += n;
+    bytes += out.size();
+    return write_all(fd, out.data(), out.size());
+}
+
+bool tile_encoder::repeat(bool key)
+{
+    return started && write(prev.data(), key);
+}
+
+void tile_encoder::encode(const uint32_t *frame, unsigned tx, unsigned ty)
+{
+    const unsigned x0 = tx * TILE, y0 = ty * TILE;
+    const unsigned w = std::min(TILE, width - x0), h = std::min(TILE, height - y0), count = w * h;
+    put16(out, ty * columns + tx);
+
+    // palette in order of appearance, hashed by colour
+    if (++stamp == 0) {
+        for (slot &s : table)
+            s.stamp = 0;
+        stamp = 1;
+    }
+    uint32_t palette[256];
+    uint8_t index[TILE * TILE];
+    unsigned colours = 0;
+    bool raw = false;
+    for (unsigned y = 0, i = 0; y < h && !raw; ++y) {
+        const uint32_t *row = frame + (y0 + y) * width + x0;
+        for (unsigned x = 0; x < w; ++x, ++i) {
+            const uint32_t c = row[x];
+            unsigned at = (c * 0x9e3779b1u) >> 23;
+            while (table[at].stamp == stamp && table[at].colour != c)
+                at = (at + 1) % TABLE_SIZE;
+            if (table[at].stamp != stamp) {
+                if (colours == 256) {
+                    raw = true;
+                    break;
+                }
+                table[at].colour = c;
+                table[at].stamp = stamp;
+                table[at].index = colours;
+                palette[colours++] = c;
+            }
+            index[i] = table[at].index;
+        }
+    }
+    if (!raw && colours == 1) {
+        out.push_back(TILE_FILL);
+        put32(out, palette[0]);
+        ++coded[TILE_FILL];
+        return;
+    }
+    // runs of at most 256 of one index
+    unsigned runs = 0;
+    for (unsigned i = 0, length = 0; i < count && !raw; ++i, ++length) {
+        if (i == 0 || index[i] != index[i - 1] || length == 256) {
+            ++runs;
+            length = 0;
+        }
+    }
+    const unsigned bits = index_bits(colours);
+    const unsigned packed = (count * bits + 7) / 8, run_bytes = 2 * runs;
+    const unsigned palette_bytes = 1 + 4 * colours;
+    if (raw || palette_bytes + std::min(packed, run_bytes) >= 4 * count) {
+        out.push_back(TILE_RAW);
+        for (unsigned y = 0; y < h; ++y)
+            for (unsigned x = 0; x < w; ++x)
+                put32(out, frame[(y0 + y) * width + x0 + x]);
+        ++coded[TILE_RAW];
+        return;
+    }
+    const tile_coding coding = packed <= run_bytes ? TILE_PACKED : TILE_RUNS;
+    out.push_back(coding);
+    out.push_back(colours - 1);
+    for (unsigned i = 0; i < colours; ++i)
+        put32(out, palette[i]);
+    if (coding == TILE_PACKED) {
+        const size_t at = out.size();
+        out.resize(at + packed, 0);
+        uint8_t *p = &out[at];
+        for (unsigned i = 0; i < count; ++i)
+            p[i * bits / 8] |= index[i] << (i * bits % 8);
+    } else {
+        for (unsigned i = 0; i < count;) {
+            unsigned length = 1;
+            while (i + length < count && index[i + length] == index[i] && length < 256)
+                ++length;
+            out.push_back(index[i]);
+            out.push_back(length - 1);
+            i += length;
+        }
+    }
+    ++coded[coding];
+}
+
+tile_decoder::tile_decoder(FILE *f)
+    : width(0), height(0), tile(0), fps(0), columns(0), rows(0), in(f)
+{
+    uint8_t header[HEADER_SIZE];
+    if (fread(header, 1, HEADER_SIZE, in) != HEADER_SIZE || memcmp(header, MAGIC, 4) != 0)
+        return;
+    const unsigned w = get16(header + 4), h = get16(header + 6), t = header[8];
+    if (!w || !h || !t)
+        return;
+    width = w;
+    height = h;
+    tile = t;
+    fps = header[9];
+    columns = (w + t - 1) / t;
+    rows = (h + t - 1) / t;
+    pixels.assign(w * h, 0xff000000u);
+}
+
+int tile_decoder::next()
+{
+    uint8_t len[4];
+    const size_t got = fread(len, 1, 4, in);
+    if (got == 0 && feof(in))
+        return 0;
+    if (got != 4)
+        return -1;
+    data.resize(get32(len));
+    if (data.size() < 2 || fread(data.data(), 1, data.size(), in) != data.size())
+        return -1;
+    const uint8_t *p = data.data(), *const end = p + data.size();
+    const unsigned n = get16(p);
+    p += 2;
+    updated.clear();
+    for (unsigned i = 0; i < n; ++i)
+        if (!decode(p, end))
+            return -1;
+    return p == end ? 1 : -1;
+}
+
+/* one tile at p, which is advanced past it; false if it runs past end or
+ * does not make sense */
+bool tile_decoder::decode(const uint8_t *&p, const uint8_t *end)
+{
+    if (end - p < 3)
+        return false;
+    const unsigned t = get16(p), coding = p[2];
+    p += 3;
+    if (t >= columns * rows)
+        return false;
+    const unsigned x0 = t % columns * tile, y0 = t / columns * tile;
+    const unsigned w = std::min(tile, width - x0), h = std::min(tile, height - y0), count = w * h;
+    uint32_t *const dst = &pixels[y0 * width + x0];
+    // pixel i of the tile
+    auto at = [&](unsigned i) -> uint32_t & {return dst[i / w * width + i % w];};
+    switch (coding) {
+    case TILE_FILL: {
+        if (end - p < 4)
+            return false;
+        const uint32_t c = get32(p);
+        p += 4;
+        for (unsigned y = 0; y < h; ++y)
+            std::fill(dst + y * width, dst + y * width + w, c);
+        break;
+    }
+    case TILE_PACKED:
+    case TILE_RUNS: {
+        if (end - p < 1)
+            return false;
+        const unsigned colours = *p++ + 1;
+        if (size_t(end - p) < 4 * colours)
+            return false;
+        uint32_t palette[256];
+        for (unsigned i = 0; i < colours; ++i, p += 4)
+            palette[i] = get32(p);
+        if (coding == TILE_PACKED) {
+            const unsigned bits = index_bits(colours), mask = (1 << bits) - 1;
+            const unsigned packed = (count * bits + 7) / 8;
+            if (size_t(end - p) < packed)
+                return false;
+            for (unsigned i = 0; i < count; ++i) {
+                const unsigned c = p[i * bits / 8] >> (i * bits % 8) & mask;
+                if (c >= colours)
+                    return false;
+                at(i) = palette[c];
+            }
+            p += packed;
+        } else {
+            for (unsigned i = 0; i < count;) {
+                if (end - p < 2 || p[0] >= colours || i + p[1] + 1 > count)
+                    return false;
+                const uint32_t c = palette[p[0]];
+                for (unsigned length = p[1] + 1; length; --length)
+                    at(i++) = c;
+                p += 2;
+            }
+        }
+        break;
+    }
+    case TILE_RAW:
+        if (size_t(end - p) < 4 * count)
+            return false;
+        for (unsigned i = 0; i < count; ++i, p += 4)
+            at(i) = get32(p);
+        break;
+    default:
+        return false;
+    }
+    updated.push_back(t);
+    return true;
+}
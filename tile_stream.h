@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vector>
+
+/* Tile delta stream of ARGB8888 frames, for remote or recorded displays.
+ * Frames are cut into 32x32 tiles and only the tiles that differ from the
+ * previous frame are sent. The upscaled screens have few colours per tile,
+ * so a tile is coded as one colour, as palette indices packed to 1, 2, 4 or
+ * 8 bits, as runs of palette indices, or raw, whichever is smallest.
+ *
+ * All numbers are little endian. The stream starts with
+ *     "ZXT1", u16 width, u16 height, u8 tile size, u8 frames/s
+ * and every frame is
+ *     u32 bytes following, u16 tiles, tiles
+ * where a tile is its u16 index (row major) and u8 coding:
+ *     TILE_FILL     u32 colour
+ *     TILE_PACKED   u8 colours - 1, palette (u32 each), indices LSB first
+ *     TILE_RUNS     u8 colours - 1, palette, (u8 index, u8 length - 1)...
+ *     TILE_RAW      u32 per pixel
+ * Pixels are in row order of the tile, edge tiles are cut to the frame. */
+
+enum tile_coding {
+    TILE_FILL,
+    TILE_PACKED,
+    TILE_RUNS,
+    TILE_RAW,
+};
+
+class tile_encoder {
+public:
+    static const unsigned TILE = 32;
+
+    tile_encoder(int fd, unsigned width, unsigned height, unsigned fps);
+
+    /* the tiles of frame (width pixels per row) that changed since the last
+     * one, all of them if key is set; returns false on I/O errors */
+    bool write(const uint32_t *frame, bool key = false);
+    /* the last frame again, an empty frame unless key is set */
+    bool repeat(bool key = false);
+
+    /* totals over the frames written */
+    uint64_t frames, tiles, bytes;
+    uint64_t coded[TILE_RAW + 1]; // tiles per coding
+
+private:
+    void encode(const uint32_t *frame, unsigned tx, unsigned ty);
+
+    int fd;
+    unsigned width, height, fps;
+    unsigned columns, rows;
+    bool started;
+    std::vector<uint32_t> prev;
+    std::vector<uint8_t> out; // the frame being coded
+    // palette lookup by colour, entries are valid if stamped with the tile
+    struct slot {
+        uint32_t colour;
+        uint32_t stamp;
+        uint8_t index;
+    };
+    std::vector<slot> table;
+    uint32_t stamp;
+};
+
+class tile_decoder {
+public:
+    /* reads the stream header, ok() is false if there is none */
+    explicit tile_decoder(FILE *in);
+
+    bool ok() const {return width != 0;}
+
+    /* applies the next frame, returns 1 if there was one, 0 at the end of
+     * the stream and -1 if it is corrupt or cut short */
+    int next();
+
+    /* the current frame, width pixels per row */
+    const uint32_t *frame() const {return pixels.data();}
+    /* indices of the tiles the last frame changed */
+    const std::vector<unsigned> &changed() const {return updated;}
+
+    unsigned width, height, tile, fps;
+    unsigned columns, rows;
+
+private:
+    bool decode(const uint8_t *&p, const uint8_t *end);
+
+    FILE *in;
+    std::vector<uint32_t> pixels;
+    std::vector<uint8_t> data;
+    std::vector<unsigned> updated;
+};
@@ -0,0 +1,140 @@
+/* Decoder and player of the tile delta streams scrrec -t writes, e.g.
+ *     scrrec -t -n 500 screens | tileplay -w
+ * Decodes every frame, optionally writes them as PNG images or shows them in
+ * a window at the stream's frame rate, and reports the decoding speed. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "image.h"
+#include "tile_stream.h"
+
+#ifdef HAVE_SDL
+#include <SDL2/SDL.h>
+#endif
+
+static void usage()
+{
+    fprintf(stderr, "usage: tileplay [-o outdir] [-w] [in.zxt]\n");
+    exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *out_dir = NULL;
+    bool window = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "o:w")) != -1) {
+        switch (opt) {
+        case 'o':
+            out_dir = optarg;
+            break;
+        case 'w':
+            window = true;
+            break;
+        default:
+            usage();
+        }
+    }
+    const char *in_path = optind < argc ? argv[optind] : "-";
+    FILE *in = strcmp(in_path, "-") ? fopen(in_path, "rb") : stdin;
+    if (!in) {
+        perror(in_path);
+        return -1;
+    }
+    tile_decoder stream(in);
+    if (!stream.ok()) {
+        fprintf(stderr, "%s: not a tile stream\n", in_path);
+        return -1;
+    }
+
+#ifdef HAVE_SDL
+    SDL_Renderer *renderer = NULL;
+    SDL_Texture *texture = NULL;
+    Uint32 started = 0;
+    if (window) {
+        SDL_Init(SDL_INIT_VIDEO);
+        SDL_Window *w = SDL_CreateWindow("tileplay", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                                         stream.width, stream.height, 0);
+        renderer = SDL_CreateRenderer(w, -1, 0);
+        texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                                    stream.width, stream.height);
+        started = SDL_GetTicks();
+    }
+#else
+    if (window) {
+        fprintf(stderr, "tileplay: built without SDL, no window\n");
+        return -1;
+    }
+#endif
+
+    unsigned long long frames = 0, tiles = 0, written = 0;
+    double decode_secs = 0;
+    int status;
+    for (;;) {
+        auto start = std::chrono::steady_clock::now();
+        status = stream.next();
+        decode_secs += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (status <= 0)
+            break;
+        ++frames;
+        tiles += stream.changed().size();
+        if (out_dir && !stream.changed().empty()) {
+            char path[4096];
+            snprintf(path, sizeof(path), "%s/frame_%06llu.png", out_dir, frames - 1);
+            if (!write_png(path, stream.frame(), stream.width, stream.height)) {
+                perror(path);
+                return -1;
+            }
+            ++written;
+        }
+#ifdef HAVE_SDL
+        if (window) {
+            SDL_Event event;
+            bool quit = false;
+            while (SDL_PollEvent(&event))
+                quit |= event.type == SDL_QUIT;
+            if (quit)
+                break;
+            // only the tiles sent are uploaded, frames without any are just waited for
+            for (unsigned t : stream.changed()) {
+                SDL_Rect r;
+                r.x = t % stream.columns * stream.tile;
+                r.y = t / stream.columns * stream.tile;
+                r.w = std::min(stream.tile, stream.width - r.x);
+                r.h = std::min(stream.tile, stream.height - r.y);
+                SDL_UpdateTexture(texture, &r, stream.frame() + r.y * stream.width + r.x,
+                                  stream.width * sizeof(uint32_t));
+            }
+            SDL_RenderCopy(renderer, texture, NULL, NULL);
+            SDL_RenderPresent(renderer);
+            // paced from the start, so slow frames do not add up
+            if (stream.fps) {
+                const Uint32 due = started + Uint32(frames * 1000 / stream.fps), now = SDL_GetTicks();
+                if (int32_t(due - now) > 0)
+                    SDL_Delay(due - now);
+            }
+        }
+#endif
+    }
+#ifdef HAVE_SDL
+    if (window)
+        SDL_Quit();
+#endif
+    if (status < 0)
+        fprintf(stderr, "%s: corrupt or truncated after frame %llu\n", in_path, frames);
+    fprintf(stderr, "%llu frames of %ux%u, %.1f tiles/frame, decoding %.3f ms/frame", frames, stream.width,
+            stream.height, frames ? double(tiles) / frames : 0.0, frames ? decode_secs * 1000 / frames : 0.0);
+    if (out_dir)
+        fprintf(stderr, ", %llu images written", written);
+    fprintf(stderr, "\n");
+    if (in != stdin)
+        fclose(in);
+    return status < 0 ? 1 : 0;
+}
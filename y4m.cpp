@@ -0,0 +1,88 @@
+#include <errno.h>
+#include <stdio.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "y4m.h"
+
+y4m_writer::y4m_writer(int f, unsigned w, unsigned h, unsigned r, bool s)
+    : fd(f), width(w), height(h), fps(r), subsample(s), started(false)
+{
+    const unsigned chroma = s ? (w / 2) * (h / 2) : w * h;
+    planes.resize(w * h + 2 * chroma);
+}
+
+static inline uint8_t clamp8(int v)
+{
+    return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+bool y4m_writer::write(const YUV_pixel *frame)
+{
+    uint8_t *y = planes.data();
+    for (unsigned i = 0; i < width * height; ++i)
+        y[i] = clamp8(frame[i].y);
+    uint8_t *u = y + width * height;
+    if (!subsample) {
+        uint8_t *v = u + width * height;
+        for (unsigned i = 0; i < width * height; ++i) {
+            u[i] = clamp8(frame[i].u + 128);
+            v[i] = clamp8(frame[i].v + 128);
+        }
+        return flush();
+    }
+    const unsigned cw = width / 2, ch = height / 2;
+    uint8_t *v = u + cw * ch;
+    for (unsigned j = 0; j < ch; ++j) {
+        const YUV_pixel *a = frame + 2 * j * width, *b = a + width;
+        for (unsigned i = 0; i < cw; ++i) {
+            const int su = a[2 * i].u + a[2 * i + 1].u + b[2 * i].u + b[2 * i + 1].u;
+            const int sv = a[2 * i].v + a[2 * i + 1].v + b[2 * i].v + b[2 * i + 1].v;
+            u[j * cw + i] = clamp8(((su + 2) >> 2) + 128);
+            v[j * cw + i] = clamp8(((sv + 2) >> 2) + 128);
+        }
+    }
+    return flush();
+}
+
+bool y4m_writer::repeat()
+{
+    return started && flush();
+}
+
+/* the stream header (before the first frame), the frame header and the 3
+ * planes go out in a single writev() */
+bool y4m_writer::flush()
+{
+    char header[128];
+    int len = 0;
+    if (!started) {
+        len = snprintf(header, sizeof(header), "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 %s XCOLORRANGE=FULL\n",
+                       width, height, fps, subsample ? "C420jpeg" : "C444");
+        started = true;
+    }
+    len += snprintf(header + len, sizeof(header) - len, "FRAME\n");
+    struct iovec iov[2] = {{header, size_t(len)}, {planes.data(), planes.size()}};
+    struct iovec *next = iov;
+    int count = 2;
+    while (count) {
+        const ssize_t n = writev(fd, next, count);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        // partial writes, e.g. to a pipe, continue where they stopped
+        size_t done = n;
+        while (count && done >= next->iov_len) {
+            done -= next->iov_len;
+            ++next;
+            --count;
+        }
+        if (count) {
+            next->iov_base = static_cast<char *>(next->iov_base) + done;
+            next->iov_len -= done;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "colors.h"
+
+/* YUV4MPEG2 stream of YUV frames as produced by hqx_filter(), full range
+ * BT.601 (u and v are offset by 128), either 4:4:4 or with the chroma
+ * averaged over 2x2 pixels to 4:2:0. */
+class y4m_writer {
+public:
+    y4m_writer(int fd, unsigned width, unsigned height, unsigned fps, bool subsample);
+
+    /* returns false on I/O errors */
+    bool write(const YUV_pixel *frame);
+    /* the last frame written again */
+    bool repeat();
+
+private:
+    bool flush();
+
+    int fd;
+    unsigned width, height, fps;
+    bool subsample;
+    bool started;
+    std::vector<uint8_t> planes; // Y, U and V of the last frame
+};
@@ -0,0 +1,133 @@
+#include <string.h>
+
+#include "zxscreen.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define HAVE_SSSE3_DECODER 1
+#include <immintrin.h>
+#endif
+
+uint8_t get_sinclair_color(const uint8_t *pix, const uint8_t *attr, unsigned x, unsigned y, unsigned flash) {
+    unsigned yb = y >> 3, xb = x >> 3, xbit = x & 0b111;
+    uint8_t a = attr[yb * MAXX + xb];
+    uint8_t fg = 0b111 & a;
+    uint8_t bg = 0b111 & (a >> 3);
+    uint8_t bright = (a >> 6) & 1;
+    uint8_t pix8 = pix[zx_line_offset(y) + xb] ^ zx_flash_mask(a, flash);
+    return (bright << 3) | ((pix8 & (1 << (7 - xbit)))?fg:bg);
+}
+
+namespace {
+
+/* bitmap byte -> 8 byte mask, 0xff for every set bit, leftmost pixel first */
+struct expand_table {
+    uint64_t mask[256];
+    expand_table() {
+        for (unsigned b = 0; b < 256; ++b) {
+            uint64_t m = 0;
+            for (unsigned i = 0; i < 8; ++i)
+                if (b & (0x80 >> i))
+                    m |= uint64_t(0xff) << (i * 8);
+            mask[b] = m;
+        }
+    }
+};
+
+const expand_table expand;
+
+inline uint64_t replicate(uint8_t ci) {return ci * 0x0101010101010101ull;}
+
+inline void decode_byte(uint8_t pix8, uint8_t a, uint8_t *out)
+{
+    const uint8_t bright = (a >> 3) & 0b1000;
+    const uint64_t ink = replicate(bright | (a & 0b111));
+    const uint64_t paper = replicate(bright | ((a >> 3) & 0b111));
+    const uint64_t m = expand.mask[pix8];
+    const uint64_t px = (ink & m) | (paper & ~m);
+    memcpy(out, &px, 8);
+}
+
+typedef void (*line_decoder)(const uint8_t *, const uint8_t *, uint8_t *, unsigned);
+
+void decode_line_scalar(const uint8_t *pix8, const uint8_t *a, uint8_t *out, unsigned flash)
+{
+    for (unsigned xb = 0; xb < MAXX; ++xb)
+        decode_byte(pix8[xb] ^ zx_flash_mask(a[xb], flash), a[xb], out + xb * 8);
+}
+
+#ifdef HAVE_SSSE3_DECODER
+/* 2 bitmap bytes -> 16 pixels per step: every byte is broadcast over 8 lanes
+ * with pshufb, tested against its bit and used to select ink or paper */
+__attribute__((target("ssse3")))
+void decode_line_ssse3(const uint8_t *pix8, const uint8_t *a, uint8_t *out, unsigned flash)
+{
+    const __m128i spread = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+    const __m128i bits = _mm_setr_epi8(-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1);
+    for (unsigned xb = 0; xb < MAXX; xb += 2) {
+        uint16_t p2, a2;
+        memcpy(&p2, pix8 + xb, 2);
+        memcpy(&a2, a + xb, 2);
+        p2 ^= zx_flash_mask(a[xb], flash) | zx_flash_mask(a[xb + 1], flash) << 8;
+        const __m128i av = _mm_shuffle_epi8(_mm_cvtsi32_si128(a2), spread);
+        const __m128i bright = _mm_and_si128(_mm_srli_epi16(av, 3), _mm_set1_epi8(0b1000));
+        const __m128i ink = _mm_or_si128(bright, _mm_and_si128(av, _mm_set1_epi8(0b111)));
+        const __m128i paper = _mm_or_si128(bright, _mm_and_si128(_mm_srli_epi16(av, 3), _mm_set1_epi8(0b111)));
+        const __m128i pv = _mm_shuffle_epi8(_mm_cvtsi32_si128(p2), spread);
+        const __m128i m = _mm_cmpeq_epi8(_mm_and_si128(pv, bits), bits);
+        const __m128i px = _mm_or_si128(_mm_and_si128(m, ink), _mm_andnot_si128(m, paper));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + xb * 8), px);
+    }
+}
+#endif
+
+line_decoder decode_line = decode_line_scalar;
+
+}
+
+bool zx_decode_simd(bool use_simd)
+{
+#ifdef HAVE_SSSE3_DECODER
+    if (use_simd && __builtin_cpu_supports("ssse3")) {
+        decode_line = decode_line_ssse3;
+        return true;
+    }
+#endif
+    decode_line = decode_line_scalar;
+    return !use_simd;
+}
+
+void zx_decode(const uint8_t *pix, const uint8_t *attr, uint8_t *fb, unsigned flash)
+{
+    // walk the bitmap in memory order: thirds, pixel lines, character rows
+    for (unsigned row = 0; row < MAXY * 8; ++row) {
+        const unsigned yb = (row >> 3 & 0b11000) | (row & 0b111);
+        const unsigned y = yb * 8 + ((row >> 3) & 0b111);
+        decode_line(pix + row * MAXX, attr + yb * MAXX, fb + y * MAXX * 8, flash);
+    }
+}
+
+void zx_decode_cell(const uint8_t *pix, const uint8_t *attr, unsigned xb, unsigned yb, uint8_t *fb,
+                    unsigned flash)
+{
+    const uint8_t a = attr[yb * MAXX + xb], invert = zx_flash_mask(a, flash);
+    for (unsigned y = yb * 8; y < yb * 8 + 8; ++y)
+        decode_byte(pix[zx_line_offset(y) + xb] ^ invert, a, fb + y * MAXX * 8 + xb * 8);
+}
+
+void zx_decode_line(const uint8_t *pix, const uint8_t *attr, unsigned y, uint8_t *out, unsigned flash)
+{
+    decode_line(pix + zx_line_offset(y), attr + (y >> 3) * MAXX, out, flash);
+}
+
+void zx_decode_border_line(const uint8_t *pix, const uint8_t *attr, const uint8_t *border, unsigned y,
+                           uint8_t *out, unsigned flash)
+{
+    const unsigned paper_y = y - ZX_BORDER_TOP;
+    if (paper_y >= MAXY * 8) {
+        memset(out, border[y] & 0b111, ZX_BORDER_W);
+        return;
+    }
+    memset(out, border[y] & 0b111, ZX_BORDER_LEFT);
+    decode_line(pix + zx_line_offset(paper_y), attr + (paper_y >> 3) * MAXX, out + ZX_BORDER_LEFT, flash);
+    memset(out + ZX_BORDER_LEFT + MAXX * 8, border[y] & 0b111, ZX_BORDER_W - ZX_BORDER_LEFT - MAXX * 8);
+}
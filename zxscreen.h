@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+
+/* screen size in 8x8 character cells */
+const unsigned MAXX = 32;
+const unsigned MAXY = 24;
+
+/* The bitmap is 6144 bytes in Spectrum memory order (thirds, then pixel line,
+ * then character row), followed in .scr dumps by 768 attribute bytes. The
+ * decoders write palette indices (bright << 3 | grb) into a 256x192 fb. */
+
+/* Cells with FLASH (attribute bit 7) swap ink and paper every 16 frames.
+ * The decoders take the flash phase, 0 or 1; swapping in phase 1 is the
+ * same as inverting the cell's bitmap bytes. */
+const unsigned ZX_FLASH_FRAMES = 16;
+
+inline uint8_t zx_flash_mask(uint8_t attr, unsigned flash)
+{
+    return flash && (attr & 0x80) ? 0xff : 0;
+}
+
+/* palette index of a single pixel, the slow reference */
+uint8_t get_sinclair_color(const uint8_t *pix, const uint8_t *attr, unsigned x, unsigned y, unsigned flash = 0);
+
+/* Picks the line decoder of zx_decode(), zx_decode_line() and
+ * zx_decode_border_line(): the SSSE3 one if use_simd and the CPU has it, else
+ * the scalar one. Called by simd_init() and simd_select(); false if use_simd
+ * could not be honoured. */
+bool zx_decode_simd(bool use_simd);
+
+/* whole screen */
+void zx_decode(const uint8_t *pix, const uint8_t *attr, uint8_t *fb, unsigned flash = 0);
+
+/* the 8x8 cell at character position (xb, yb) */
+void zx_decode_cell(const uint8_t *pix, const uint8_t *attr, unsigned xb, unsigned yb, uint8_t *fb,
+                    unsigned flash = 0);
+
+/* the 256 pixels of line y */
+void zx_decode_line(const uint8_t *pix, const uint8_t *attr, unsigned y, uint8_t *out, unsigned flash = 0);
+
+/* offset of pixel line y in the bitmap */
+inline unsigned zx_line_offset(unsigned y)
+{
+    return (y & 0b11000000) << 5 | (y & 0b111) << 8 | (y & 0b111000) << 2;
+}
+
+/* Border mode: the paper surrounded by the border as on a TV, 320x240
+ * pixels with the paper at (32, 24). The border colour (0-7) is given per
+ * line, border[] holds the 240 of them. */
+const unsigned ZX_BORDER_W = 320, ZX_BORDER_H = 240;
+const unsigned ZX_BORDER_LEFT = 32, ZX_BORDER_TOP = 24;
+
+/* the 320 pixels of line y in border mode */
+void zx_decode_border_line(const uint8_t *pix, const uint8_t *attr, const uint8_t *border, unsigned y,
+                           uint8_t *out, unsigned flash = 0);